@@ -19,14 +19,18 @@
 #undef near
 #undef far
 
-// Vertex shader implementation.
-class simple_vertex_t : public swrast::vertex_shader_t
+// Per draw constants of the vertex shader, read from constant buffer slot 0.
+struct transform_constants_t
 {
-public:
     swrast::float4x4_t mvp;
     swrast::float4x4_t m;
     swrast::float4x4_t n;
+};
 
+// Vertex shader implementation.
+class simple_vertex_t : public swrast::vertex_shader_t
+{
+public:
     struct in_vert_t
     {
         swrast::float3_t pos;
@@ -48,31 +52,61 @@ public:
     {
         set_out_vert_info(sizeof(out_vert_t), sizeof(swrast::float4_t));
         set_in_vert_info(sizeof(in_vert_t));
+        set_batch_execution(true);
+    }
+
+    swrast::vertex_shader_t* clone() const override
+    {
+        return new simple_vertex_t(*this);
     }
 
     // Must output a vertex, in clip space.
-    void execute(uintptr_t in_vertex_ptr, uintptr_t out_vertex, uint32_t vert_id) override
+    void execute(uintptr_t in_vertex_ptr, uintptr_t out_vertex, uint32_t vert_id, uint32_t instance_id) override
     {
         swrast::float3_t c[] = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} }; 
+        const transform_constants_t& cb = constants<transform_constants_t>(0);
         in_vert_t* in_vert = (in_vert_t*)in_vertex_ptr;
         out_vert_t* out = (out_vert_t*)out_vertex;
-        out->pos = swrast::float4_t(in_vert->pos, 1.0f) * mvp;
+        out->pos = swrast::float4_t(in_vert->pos, 1.0f) * cb.mvp;
         out->color = in_vert->color;
         out->texcoord = in_vert->texcoord;
-        swrast::float4_t frag_pos = swrast::float4_t(in_vert->pos, 1.0f) * m;
+        swrast::float4_t frag_pos = swrast::float4_t(in_vert->pos, 1.0f) * cb.m;
         
         out->frag_pos = swrast::float3_t(frag_pos.x, frag_pos.y, frag_pos.z);
-        swrast::float4_t nn = swrast::float4_t(in_vert->normal, 0.0f) * n;
+        swrast::float4_t nn = swrast::float4_t(in_vert->normal, 0.0f) * cb.n;
         out->normal = swrast::float3_t(nn.x, nn.y, nn.z);
     }
+
+    // Same as execute(), but works on 8 vertices at a time. Each float8_t holds one 
+    // member of in_vert_t/out_vert_t, for all vertices in the batch.
+    void execute_batch(swrast::vertex_batch_t& batch) override
+    {
+        const transform_constants_t& cb = constants<transform_constants_t>(0);
+        const swrast::float8_t* in = batch.in;
+        swrast::float8_t* out = batch.out;
+        const swrast::float8_t one(1.0f);
+        const swrast::float8_t zero(0.0f);
+        swrast::float8_t temp[4];
+
+        // color.
+        out[0] = in[3]; out[1] = in[4]; out[2] = in[5]; out[3] = in[6];
+        // pos.
+        transform_batch(cb.mvp, in[0], in[1], in[2], one, &out[4]);
+        // normal.
+        transform_batch(cb.n, in[7], in[8], in[9], zero, temp);
+        out[8] = temp[0]; out[9] = temp[1]; out[10] = temp[2];
+        // texcoord.
+        out[11] = in[10]; out[12] = in[11];
+        // frag_pos.
+        transform_batch(cb.m, in[0], in[1], in[2], one, temp);
+        out[13] = temp[0]; out[14] = temp[1]; out[15] = temp[2];
+    }
 };
 
 // Pixel shader implementation.
 class simple_pixel_t : public swrast::pixel_shader_t
 {
 public:
-    swrast::resource_t m_texture;
-
     swrast::float3_t light_pos;
     swrast::float4_t light_color;
     
@@ -94,7 +128,11 @@ public:
         varying_attribute(44, data_type_float3, interpolation_perspective);
         varying_attribute(56, data_type_float2, interpolation_perspective);
         varying_attribute(64, data_type_float3, interpolation_perspective);
-        m_texture = 0;
+    }
+
+    swrast::pixel_shader_t* clone() const override
+    {
+        return new simple_pixel_t(*this);
     }
 
     // Should output the color. Ideally we want to pass in the 
@@ -115,6 +153,7 @@ public:
         desc.address_v = swrast::texture_address_mode_clamp;
         //varying.texcoord = varying.texcoord * 2.5f;
         swrast::float4_t color;
+        swrast::resource_t m_texture = shader_resource(0);
 #if USE_TEXTURE_FETCH
         swrast::float3_t tex_size = texture_size(m_texture);
         swrast::uint x = swrast::clamp(varying.texcoord.x * tex_size.x, 0.f, tex_size.x - 1);
@@ -198,7 +237,7 @@ int main(int c, char* argv[])
     //swrast::shader_t ps = swrast::create_shader(swrast::shader_type_pixel, nullptr, 0);
     swrast::input_layout_t layout = 0;
     {
-        swrast::input_element_desc inputs[4];
+        swrast::input_element_desc inputs[4] = { };
         inputs[0].format = swrast::format_r32g32b32_float;
         inputs[0].input_slot = 0;
         inputs[0].offset = 0;
@@ -304,7 +343,6 @@ int main(int c, char* argv[])
     vs->setup();
     simple_pixel_t* ps = new simple_pixel_t();
     ps->setup();
-    ps->m_texture = tex;
     ps->light_color = swrast::float4_t(1, 1, 1, 1);
     ps->light_pos = swrast::float3_t(-1, -2, 2);
 
@@ -318,9 +356,20 @@ int main(int c, char* argv[])
     mm[14] = 0;
     mm[15] = 1;
     swrast::float4x4_t N = swrast::transpose<float>(swrast::inverse<float>(mm)); // need to inverse-transpose the model matrix, to correct the normals.
-    vs->mvp =  model * swrast::perspective_lh_aspect(swrast::deg_to_rad(45.0f), (float)screen_width/(float)screen_height, 0.001f, 1000.0f);
-    vs->m = model;
-    vs->n = N;
+    resource_desc = { };
+    resource_desc.type = swrast::resource_type_buffer;
+    resource_desc.width = sizeof(transform_constants_t);
+    resource_desc.height = 1;
+    resource_desc.depth_or_array_size = 1;
+    resource_desc.mip_count = 1;
+    resource_desc.usage = swrast::usage_constant_buffer;
+    swrast::resource_t cb = swrast::allocate_resource(resource_desc);
+    transform_constants_t* constants = nullptr;
+    swrast::map_resource_discard((void**)&constants, cb);
+    constants->mvp =  model * swrast::perspective_lh_aspect(swrast::deg_to_rad(45.0f), (float)screen_width/(float)screen_height, 0.001f, 1000.0f);
+    constants->m = model;
+    constants->n = N;
+    swrast::unmap_resource(cb);
 
     swrast::viewport_t viewport = { };
     viewport.x = viewport.y = 0;
@@ -337,15 +386,25 @@ int main(int c, char* argv[])
     clear_rect.height = viewport.height;
     swrast::clear_render_target(0, clear_rect, rgba);
     swrast::clear_depth_stencil(0.f, clear_rect);
-    swrast::set_front_face(swrast::front_face_counter_clockwise);
-    swrast::set_depth_compare(swrast::compare_op_greater);
-    swrast::set_cull_mode(swrast::cull_mode_front);
-    swrast::set_input_layout(layout);
+    swrast::pipeline_state_desc_t pipeline_desc = { };
+    pipeline_desc.vertex_shader = vs;
+    pipeline_desc.pixel_shader = ps;
+    pipeline_desc.input_layout = layout;
+    pipeline_desc.primitive_topology = swrast::primitive_topology_trianglelist;
+    pipeline_desc.cull_mode = swrast::cull_mode_front;
+    pipeline_desc.front_face = swrast::front_face_counter_clockwise;
+    pipeline_desc.line_width = 1.f;
+    pipeline_desc.point_size = 1.f;
+    pipeline_desc.depth_enable = true;
+    pipeline_desc.depth_write_enable = true;
+    pipeline_desc.depth_compare = swrast::compare_op_greater;
+    swrast::pipeline_state_t cube_pipeline = swrast::create_pipeline_state(pipeline_desc);
+    pipeline_desc.cull_mode = swrast::cull_mode_back;
+    swrast::pipeline_state_t triangle_pipeline = swrast::create_pipeline_state(pipeline_desc);
     swrast::set_viewports(1, &viewport);
-    swrast::bind_vertex_shader(vs);
-    swrast::bind_pixel_shader(ps);
-    swrast::enable_depth(true);
-    swrast::enable_depth_write(true);
+    swrast::bind_pipeline_state(cube_pipeline);
+    swrast::bind_const_buffer(0, cb);
+    swrast::bind_shader_resource(0, tex);
     swrast::bind_vertex_buffers(1, &vb);
     swrast::bind_index_buffer(ib);
     // Draws the rectangle.
@@ -355,13 +414,22 @@ int main(int c, char* argv[])
     rot = swrast::rotate<float>(swrast::identity<float>(), swrast::float3_t(0, 0, 1), swrast::deg_to_rad(45.f));
     t = swrast::translate<float>(swrast::identity<float>(), swrast::float3_t(0, 0.2, 4.0));
     swrast::float4x4_t s = swrast::scale(swrast::identity<float>(), swrast::float3_t(0.5, 0.5, 0.5));
-    vs->mvp = s * rot * t * swrast::perspective_lh_aspect(swrast::deg_to_rad(45.0f), (float)screen_width/(float)screen_height, 0.001f, 1000.0f);
-    swrast::set_cull_mode(swrast::cull_mode_back);
+    // The first draw keeps its constants, the second one gets a new version of the buffer.
+    swrast::map_resource_discard((void**)&constants, cb);
+    constants->mvp = s * rot * t * swrast::perspective_lh_aspect(swrast::deg_to_rad(45.0f), (float)screen_width/(float)screen_height, 0.001f, 1000.0f);
+    constants->m = model;
+    constants->n = N;
+    swrast::unmap_resource(cb);
+    swrast::bind_pipeline_state(triangle_pipeline);
     swrast::draw_instanced(3, 1, 0, 0);
 
     int err = stbi_write_png("img.png", viewport.width, viewport.height, 4, (void*)rt, viewport.width * 4);
 
     err = stbi_write_png("depth.png", viewport.width, viewport.height, 4, (void*)ds, viewport.width * 4);
+    swrast::destroy_pipeline_state(triangle_pipeline);
+    swrast::destroy_pipeline_state(cube_pipeline);
+    swrast::destroy_input_layout(layout);
+    swrast::release_resource(cb);
     swrast::release_resource(tex);
     swrast::release_resource(ds);
     swrast::release_resource(vb);
@@ -0,0 +1,305 @@
+// Per draw overhead. Issues many small draws of a 12 triangle mesh, the way UI and debug layers do,
+// and reports draws per second for the different ways of submitting them.
+#include "SoftwareRaster/Context.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+typedef std::chrono::high_resolution_clock clock_type_t;
+
+const uint32_t g_target_size = 512;
+const uint32_t g_num_draws = 20000;
+
+struct transform_constants_t
+{
+    swrast::float4_t offset_scale;
+};
+
+
+// How the shaders support snapshots, which async submission takes of them for every draw.
+enum snapshot_mode_t
+{
+    snapshot_none,
+    snapshot_clone,
+    snapshot_copy
+};
+
+const char* g_snapshot_mode_names[] = { "none", "clone", "clone+copy" };
+
+
+class mesh_vertex_t : public swrast::vertex_shader_t
+{
+public:
+    struct out_vert_t
+    {
+        swrast::float4_t color;
+        swrast::float4_t pos;
+    };
+
+    void setup() override
+    {
+        set_out_vert_info(sizeof(out_vert_t), sizeof(swrast::float4_t));
+        set_in_vert_info(sizeof(swrast::float3_t));
+    }
+
+    void execute(uintptr_t in_vertex_ptr, uintptr_t out_vertex, uint32_t, uint32_t) override
+    {
+        const transform_constants_t& cb = constants<transform_constants_t>(0);
+        const swrast::float3_t& in = *(const swrast::float3_t*)in_vertex_ptr;
+        out_vert_t* out = (out_vert_t*)out_vertex;
+        out->pos = swrast::float4_t(in.x * cb.offset_scale.z + cb.offset_scale.x, in.y * cb.offset_scale.w + cb.offset_scale.y, in.z * 0.25f + 0.5f, 1.0f);
+        out->color = swrast::float4_t(in.x * 0.5f + 0.5f, in.y * 0.5f + 0.5f, in.z * 0.5f + 0.5f, 1.0f);
+    }
+
+    swrast::vertex_shader_t* clone() const override
+    {
+        return snapshot_mode != snapshot_none ? new mesh_vertex_t(*this) : nullptr;
+    }
+
+    bool copy_to(swrast::vertex_shader_t* snapshot) const override
+    {
+        if (snapshot_mode != snapshot_copy)
+        {
+            return false;
+        }
+        *(mesh_vertex_t*)snapshot = *this;
+        return true;
+    }
+
+    snapshot_mode_t snapshot_mode = snapshot_none;
+};
+
+
+class mesh_pixel_t : public swrast::pixel_shader_t
+{
+public:
+    struct in_varying_t
+    {
+        swrast::float4_t color;
+        swrast::float4_t pos;
+    };
+
+    void setup() override
+    {
+        set_varying_info(sizeof(in_varying_t), sizeof(swrast::float4_t));
+        varying_attribute(0, data_type_float4, interpolation_perspective);
+        varying_attribute(16, data_type_float4, interpolation_perspective);
+    }
+
+    swrast::float4_t execute(uintptr_t varying_address) override
+    {
+        return ((in_varying_t*)varying_address)->color;
+    }
+
+    swrast::pixel_shader_t* clone() const override
+    {
+        return snapshot_mode != snapshot_none ? new mesh_pixel_t(*this) : nullptr;
+    }
+
+    bool copy_to(swrast::pixel_shader_t* snapshot) const override
+    {
+        if (snapshot_mode != snapshot_copy)
+        {
+            return false;
+        }
+        *(mesh_pixel_t*)snapshot = *this;
+        return true;
+    }
+
+    snapshot_mode_t snapshot_mode = snapshot_none;
+};
+
+
+swrast::resource_t create_buffer(const void* data, uint32_t size_bytes, uint32_t usage)
+{
+    swrast::resource_desc_t desc = { };
+    desc.type = swrast::resource_type_buffer;
+    desc.width = size_bytes;
+    desc.height = 1;
+    desc.depth_or_array_size = 1;
+    desc.mip_count = 1;
+    desc.usage = (swrast::resource_usage_t)usage;
+    swrast::resource_t buffer = swrast::allocate_resource(desc);
+    if (data)
+    {
+        memcpy((void*)buffer, data, size_bytes);
+    }
+    return buffer;
+}
+
+
+struct scene_t
+{
+    swrast::resource_t          vb;
+    swrast::resource_t          ib;
+    swrast::resource_t          cb;
+    swrast::resource_t          rt;
+    swrast::input_layout_t      layout;
+    swrast::pipeline_state_t    pipeline;
+    mesh_vertex_t               vs;
+    mesh_pixel_t                ps;
+};
+
+
+void create_scene(scene_t& scene, snapshot_mode_t snapshot_mode)
+{
+    // Unit cube, 8 vertices and 12 triangles.
+    const float vertices[] =
+    {
+        -1, -1, -1,   1, -1, -1,   1,  1, -1,  -1,  1, -1,
+        -1, -1,  1,   1, -1,  1,   1,  1,  1,  -1,  1,  1,
+    };
+    const uint32_t indices[] =
+    {
+        0, 2, 1,  0, 3, 2,  4, 5, 6,  4, 6, 7,
+        0, 1, 5,  0, 5, 4,  3, 6, 2,  3, 7, 6,
+        0, 4, 7,  0, 7, 3,  1, 2, 6,  1, 6, 5,
+    };
+    scene.vb = create_buffer(vertices, sizeof(vertices), swrast::usage_vertex_buffer);
+    scene.ib = create_buffer(indices, sizeof(indices), swrast::usage_index_buffer);
+    scene.cb = create_buffer(nullptr, sizeof(transform_constants_t), swrast::usage_constant_buffer);
+
+    swrast::resource_desc_t desc = { };
+    desc.type = swrast::resource_type_texture2d;
+    desc.format = swrast::format_r8g8b8a8_unorm;
+    desc.width = g_target_size;
+    desc.height = g_target_size;
+    desc.depth_or_array_size = 1;
+    desc.mip_count = 1;
+    desc.usage = swrast::usage_render_target;
+    scene.rt = swrast::allocate_resource(desc);
+
+    swrast::input_element_desc element = { };
+    element.format = swrast::format_r32g32b32_float;
+    scene.layout = swrast::create_input_layout(1, &element);
+    scene.vs.setup();
+    scene.ps.setup();
+    scene.vs.snapshot_mode = snapshot_mode;
+    scene.ps.snapshot_mode = snapshot_mode;
+
+    swrast::pipeline_state_desc_t pipeline_desc = { };
+    pipeline_desc.vertex_shader = &scene.vs;
+    pipeline_desc.pixel_shader = &scene.ps;
+    pipeline_desc.input_layout = scene.layout;
+    pipeline_desc.primitive_topology = swrast::primitive_topology_trianglelist;
+    pipeline_desc.cull_mode = swrast::cull_mode_none;
+    pipeline_desc.front_face = swrast::front_face_counter_clockwise;
+    pipeline_desc.line_width = 1.f;
+    pipeline_desc.point_size = 1.f;
+    scene.pipeline = swrast::create_pipeline_state(pipeline_desc);
+}
+
+
+void destroy_scene(scene_t& scene)
+{
+    swrast::destroy_pipeline_state(scene.pipeline);
+    swrast::destroy_input_layout(scene.layout);
+    swrast::release_resource(scene.rt);
+    swrast::release_resource(scene.cb);
+    swrast::release_resource(scene.ib);
+    swrast::release_resource(scene.vb);
+}
+
+
+void bind_scene(scene_t& scene)
+{
+    swrast::viewport_t viewport = { };
+    viewport.width = g_target_size;
+    viewport.height = g_target_size;
+    viewport.far = 1.f;
+    swrast::bind_render_targets(1, &scene.rt, 0);
+    swrast::set_viewports(1, &viewport);
+    swrast::bind_pipeline_state(scene.pipeline);
+    swrast::bind_vertex_buffers(1, &scene.vb);
+    swrast::bind_index_buffer(scene.ib);
+    swrast::bind_const_buffer(0, scene.cb);
+}
+
+
+// Small meshes spread over the render target, each with its own constants, about 8x8 pixels each.
+void set_draw_constants(scene_t& scene, uint32_t draw)
+{
+    transform_constants_t* constants = nullptr;
+    swrast::map_resource_discard((void**)&constants, scene.cb);
+    const float scale = 8.f / g_target_size;
+    constants->offset_scale = swrast::float4_t((draw % 61) / 30.f - 1.f, ((draw / 61) % 61) / 30.f - 1.f, scale, scale);
+    swrast::unmap_resource(scene.cb);
+}
+
+
+// Draws per second, issuing every draw from the calling thread.
+double run_draws(scene_t& scene, bool rebind_pipeline)
+{
+    bind_scene(scene);
+    const clock_type_t::time_point start = clock_type_t::now();
+    for (uint32_t draw = 0; draw < g_num_draws; ++draw)
+    {
+        if (rebind_pipeline)
+        {
+            swrast::bind_pipeline_state(scene.pipeline);
+        }
+        set_draw_constants(scene, draw);
+        swrast::draw_indexed_instanced(36, 1, 0, 0, 0);
+    }
+    void* target = nullptr;
+    swrast::map_resource(&target, scene.rt);
+    const std::chrono::duration<double> elapsed = clock_type_t::now() - start;
+    return g_num_draws / elapsed.count();
+}
+
+
+double run_context(uint32_t num_workers, bool async_submission, bool rebind_pipeline, snapshot_mode_t snapshot_mode)
+{
+    swrast::context_desc_t desc = { };
+    desc.num_worker_threads = num_workers;
+    desc.async_submission = async_submission;
+    swrast::context_t context = swrast::create_context(desc);
+    swrast::set_current_context(context);
+    scene_t scene;
+    create_scene(scene, snapshot_mode);
+    // Warm up, so pools and caches are at their steady state size.
+    run_draws(scene, rebind_pipeline);
+    const double draws_per_second = run_draws(scene, rebind_pipeline);
+    destroy_scene(scene);
+    swrast::set_current_context(0);
+    swrast::destroy_context(context);
+    return draws_per_second;
+}
+}
+
+
+int main()
+{
+    swrast::initialize(0);
+    const uint32_t num_cores = std::thread::hardware_concurrency();
+    const uint32_t num_workers = num_cores > 1 ? num_cores - 1 : 0;
+    printf("12 triangle mesh, %u draws\n", g_num_draws);
+    printf("workers  async  pipeline rebind  snapshots   draws/s\n");
+    const uint32_t worker_counts[] = { 0, num_workers };
+    for (uint32_t workers : worker_counts)
+    {
+        for (uint32_t async = 0; async < 2; ++async)
+        {
+            for (uint32_t rebind = 0; rebind < 2; ++rebind)
+            {
+                // Only async submission snapshots the shaders.
+                const uint32_t num_snapshot_modes = async ? 3 : 1;
+                for (uint32_t mode = 0; mode < num_snapshot_modes; ++mode)
+                {
+                    const double draws_per_second = run_context(workers, async != 0, rebind != 0, (snapshot_mode_t)mode);
+                    printf("%-8u %-6s %-16s %-11s %.0f\n", workers, async ? "yes" : "no", rebind ? "yes" : "no", g_snapshot_mode_names[mode], draws_per_second);
+                }
+            }
+        }
+        if (!num_workers)
+        {
+            break;
+        }
+    }
+    swrast::destroy();
+    return 0;
+}
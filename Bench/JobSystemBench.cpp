@@ -0,0 +1,87 @@
+// Job system overhead. Measures the cost of submitting and waiting on jobs that do next to no work, 
+// for a range of worker counts and grain sizes.
+#include "JobSystem.hpp"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace swrast;
+
+namespace {
+
+typedef std::chrono::high_resolution_clock clock_type_t;
+
+// Touches every item, so the jobs can't be optimized away.
+std::atomic<uint64_t> g_sink{ 0 };
+
+
+double run_parallel_for(job_system_t& jobs, uint32_t count, uint32_t grain_size, uint32_t num_iterations)
+{
+    const clock_type_t::time_point start = clock_type_t::now();
+    for (uint32_t i = 0; i < num_iterations; ++i)
+    {
+        jobs.parallel_for(count, grain_size, [] (uint32_t begin, uint32_t end)
+        {
+            uint64_t sum = 0;
+            for (uint32_t item = begin; item < end; ++item)
+            {
+                sum += item;
+            }
+            g_sink.fetch_add(sum, std::memory_order_relaxed);
+        });
+    }
+    const std::chrono::duration<double, std::micro> elapsed = clock_type_t::now() - start;
+    return elapsed.count();
+}
+
+
+void empty_job(void*, uint32_t, uint32_t)
+{
+}
+
+
+double run_submit_wait(job_system_t& jobs, uint32_t num_jobs, uint32_t num_iterations)
+{
+    const clock_type_t::time_point start = clock_type_t::now();
+    for (uint32_t i = 0; i < num_iterations; ++i)
+    {
+        std::atomic<uint32_t> counter(num_jobs);
+        for (uint32_t job_i = 0; job_i < num_jobs; ++job_i)
+        {
+            job_t job = { };
+            job.function = &empty_job;
+            job.counter = &counter;
+            jobs.submit(job);
+        }
+        jobs.wait(counter);
+    }
+    const std::chrono::duration<double, std::micro> elapsed = clock_type_t::now() - start;
+    return elapsed.count();
+}
+}
+
+
+int main()
+{
+    const uint32_t num_cores = std::thread::hardware_concurrency();
+    const uint32_t count = 1 << 16;
+    const uint32_t num_iterations = 200;
+    const uint32_t grain_sizes[] = { 64, 256, 1024, 4096 };
+    printf("workers  grain    us/parallel_for  ns/job    us/1024 empty jobs\n");
+    for (uint32_t num_workers = 0; num_workers < maximum<uint32_t>(num_cores, 2u); num_workers = num_workers ? num_workers * 2 : 1)
+    {
+        job_system_t jobs;
+        jobs.initialize(num_workers);
+        // Warm up, so every worker has started.
+        run_parallel_for(jobs, count, grain_sizes[0], 10);
+        const double empty_us = run_submit_wait(jobs, 1024, num_iterations) / num_iterations;
+        for (uint32_t grain_size : grain_sizes)
+        {
+            const double us = run_parallel_for(jobs, count, grain_size, num_iterations) / num_iterations;
+            const uint32_t num_jobs = (count + grain_size - 1) / grain_size;
+            printf("%-8u %-8u %-16.2f %-9.1f %.2f\n", num_workers, grain_size, us, us * 1000.0 / num_jobs, empty_us);
+        }
+        jobs.release();
+    }
+    return 0;
+}
@@ -11,10 +11,35 @@ set ( SW_RASTER_BUILD_FILES
 	${SW_RASTER_SOURCE_DIR}/Rasterizer.hpp
 	${SW_RASTER_SOURCE_DIR}/ShaderOps.cpp
 	${SW_RASTER_SOURCE_DIR}/Context.cpp
+	${SW_RASTER_SOURCE_DIR}/RenderContext.hpp
 	${SW_RASTER_INCLUDE_DIR}/Math.hpp
 	${SW_RASTER_INCLUDE_DIR}/Core.hpp
 	${SW_RASTER_SOURCE_DIR}/Allocator.hpp
 	${SW_RASTER_SOURCE_DIR}/Allocator.cpp
 	${SW_RASTER_SOURCE_DIR}/Memory.cpp
 	${SW_RASTER_SOURCE_DIR}/Memory.hpp
+	${SW_RASTER_SOURCE_DIR}/PointSplat.hpp
+	${SW_RASTER_SOURCE_DIR}/PointSplat.cpp
+	${SW_RASTER_SOURCE_DIR}/FormatConversion.hpp
+	${SW_RASTER_SOURCE_DIR}/FormatConversion.cpp
+	${SW_RASTER_SOURCE_DIR}/GeometryPipeline.hpp
+	${SW_RASTER_SOURCE_DIR}/GeometryPipeline.cpp
+	${SW_RASTER_SOURCE_DIR}/Queue.hpp
+	${SW_RASTER_SOURCE_DIR}/JobSystem.hpp
+	${SW_RASTER_SOURCE_DIR}/JobSystem.cpp
+	${SW_RASTER_SOURCE_DIR}/Topology.hpp
+	${SW_RASTER_SOURCE_DIR}/Topology.cpp
+	${SW_RASTER_SOURCE_DIR}/CommandList.hpp
+	${SW_RASTER_SOURCE_DIR}/CommandList.cpp
+	${SW_RASTER_SOURCE_DIR}/ShaderSnapshots.hpp
+	${SW_RASTER_SOURCE_DIR}/SubmissionQueue.hpp
+	${SW_RASTER_SOURCE_DIR}/SubmissionQueue.cpp
+	${SW_RASTER_SOURCE_DIR}/ConstantRing.hpp
+	${SW_RASTER_SOURCE_DIR}/ConstantRing.cpp
+	${SW_RASTER_SOURCE_DIR}/PipelineState.hpp
+	${SW_RASTER_SOURCE_DIR}/PipelineState.cpp
+	${SW_RASTER_SOURCE_DIR}/Compute.hpp
+	${SW_RASTER_SOURCE_DIR}/Compute.cpp
+	${SW_RASTER_SOURCE_DIR}/Visibility.hpp
+	${SW_RASTER_SOURCE_DIR}/Visibility.cpp
 )
\ No newline at end of file
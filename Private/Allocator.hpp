@@ -79,7 +79,7 @@ public:
         const uint64_t max_size = memory_pool.get_memory_size_bytes();
         const uint64_t used_size = top - base_address;
         const uint64_t new_size = used_size + requested_size_bytes;
-        if (new_size < max_size)
+        if (new_size <= max_size)
         {
             uintptr_t allocation = top;
             top += requested_size_bytes;
@@ -0,0 +1,850 @@
+//
+#include "CommandList.hpp"
+#include "SubmissionQueue.hpp"
+#include "PipelineState.hpp"
+
+namespace swrast {
+
+
+// Fixed size arguments of each command. Arrays follow them in the command buffer.
+struct cmd_count_args_t
+{
+    uint32_t count;
+};
+
+
+struct cmd_resource_args_t
+{
+    resource_t resource;
+};
+
+
+struct cmd_pointer_args_t
+{
+    void* pointer;
+};
+
+
+struct cmd_value_args_t
+{
+    uint32_t value;
+};
+
+
+struct cmd_float_args_t
+{
+    float value;
+};
+
+
+struct cmd_set_view_instancing_args_t
+{
+    uint32_t view_count;
+    // Locations are optional, without them view i goes to slice i of the first viewport.
+    uint32_t has_locations;
+};
+
+
+struct cmd_bind_render_targets_args_t
+{
+    uint32_t    num_rtvs;
+    resource_t  dsv;
+};
+
+
+struct cmd_bind_index_buffer_args_t
+{
+    resource_t  ib;
+    format_t    format;
+};
+
+
+struct cmd_clear_render_target_args_t
+{
+    uint32_t    slot;
+    rect_t      rect;
+    float       rgba[4];
+};
+
+
+struct cmd_clear_depth_stencil_args_t
+{
+    float       depth;
+    rect_t      rect;
+};
+
+
+struct cmd_slot_args_t
+{
+    uint32_t    slot;
+    resource_t  resource;
+};
+
+
+struct cmd_bind_const_buffer_args_t
+{
+    uint32_t    slot;
+    resource_t  resource;
+    uintptr_t   version;
+};
+
+
+struct cmd_signal_fence_args_t
+{
+    fence_object_t* fence;
+    uint64_t        value;
+};
+
+
+struct cmd_draw_instanced_args_t
+{
+    uint32_t num_vertices;
+    uint32_t instance_count;
+    uint32_t first_vertex;
+    uint32_t first_instance;
+};
+
+
+struct cmd_draw_indexed_instanced_args_t
+{
+    uint32_t num_indices;
+    uint32_t num_instances;
+    uint32_t first_index;
+    uint32_t vertex_offset;
+    uint32_t first_instance;
+};
+
+
+struct cmd_dispatch_args_t
+{
+    uint32_t groups_x;
+    uint32_t groups_y;
+    uint32_t groups_z;
+};
+
+
+struct cmd_draw_indexed_indirect_args_t
+{
+    resource_t  args;
+    uint32_t    count;
+    uint32_t    stride;
+};
+
+
+// Arguments are copied out, since some hold types with a stricter alignment than the command buffer guarantees.
+template<typename type>
+static type read_args(const uint8_t* command)
+{
+    type args;
+    memcpy(&args, command + sizeof(command_header_t), sizeof(type));
+    return args;
+}
+
+
+// Variable sized data is used in place.
+template<typename args_t, typename type>
+static type* read_array(const uint8_t* command)
+{
+    return (type*)(command + command_buffer_t::get_data_offset<args_t>());
+}
+
+
+void command_buffer_t::reset()
+{
+    m_vertex_snapshots.recycle();
+    m_pixel_snapshots.recycle();
+    m_vertex_shader = nullptr;
+    m_pixel_shader = nullptr;
+    for (const_block_t* block : m_blocks)
+    {
+        block->references.fetch_sub(1, std::memory_order_release);
+    }
+    m_blocks.clear();
+    memset(m_const_buffers, 0, sizeof(m_const_buffers));
+    memset(m_recorded_versions, 0, sizeof(m_recorded_versions));
+    m_dirty_const_buffers = 0;
+    m_bound_const_buffers = 0;
+    m_data.clear();
+}
+
+
+void command_buffer_t::append(const command_buffer_t& commands)
+{
+    // Draws appended without binding their own constant buffers read the versions current right now.
+    record_const_buffer_versions();
+    for (const_block_t* block : commands.m_blocks)
+    {
+        reference_block(block);
+    }
+    for (uint32_t slot = 0; slot < SWRAST_MAX_CONST_BUFFERS; ++slot)
+    {
+        if (commands.m_bound_const_buffers & (1u << slot))
+        {
+            m_const_buffers[slot] = commands.m_const_buffers[slot];
+            m_recorded_versions[slot] = commands.m_recorded_versions[slot];
+        }
+    }
+    m_dirty_const_buffers |= commands.m_dirty_const_buffers;
+    m_bound_const_buffers |= commands.m_bound_const_buffers;
+
+    const size_t base = m_data.size();
+    m_data.insert(m_data.end(), commands.m_data.begin(), commands.m_data.end());
+    if (commands.m_vertex_snapshots.empty() && commands.m_pixel_snapshots.empty())
+    {
+        if (commands.m_vertex_shader) m_vertex_shader = commands.m_vertex_shader;
+        if (commands.m_pixel_shader) m_pixel_shader = commands.m_pixel_shader;
+        return;
+    }
+
+    // Take copies of the snapshots, and point the appended binds at them. Snapshots are bound in the order 
+    // they were taken, so the binds are matched with them in a single pass.
+    size_t vertex_snapshot = 0;
+    size_t pixel_snapshot = 0;
+    size_t offset = base;
+    while (offset < m_data.size())
+    {
+        command_header_t header;
+        memcpy(&header, &m_data[offset], sizeof(header));
+        if (header.type == command_bind_vertex_shader || header.type == command_bind_pixel_shader_snapshot)
+        {
+            void* shader = nullptr;
+            memcpy(&shader, &m_data[offset + sizeof(header)], sizeof(shader));
+            void* copy = nullptr;
+            if (header.type == command_bind_vertex_shader && vertex_snapshot < commands.m_vertex_snapshots.size() && 
+                shader == commands.m_vertex_snapshots[vertex_snapshot])
+            {
+                copy = m_vertex_snapshots.acquire(*commands.m_vertex_snapshots[vertex_snapshot++]);
+            }
+            else if (header.type == command_bind_pixel_shader_snapshot && pixel_snapshot < commands.m_pixel_snapshots.size() && 
+                shader == commands.m_pixel_snapshots[pixel_snapshot])
+            {
+                copy = m_pixel_snapshots.acquire(*commands.m_pixel_snapshots[pixel_snapshot++]);
+            }
+            if (copy)
+            {
+                memcpy(&m_data[offset + sizeof(header)], &copy, sizeof(copy));
+            }
+        }
+        offset += header.size_bytes;
+    }
+    if (commands.m_vertex_shader) m_vertex_shader = commands.m_vertex_shader;
+    if (commands.m_pixel_shader) m_pixel_shader = commands.m_pixel_shader;
+}
+
+
+void command_buffer_t::inherit_bindings(vertex_shader_t* vertex_shader, pixel_shader_t* pixel_shader, const resource_t* const_buffers)
+{
+    m_vertex_shader = vertex_shader;
+    m_pixel_shader = pixel_shader;
+    memcpy(m_const_buffers, const_buffers, sizeof(m_const_buffers));
+}
+
+
+void command_buffer_t::record_bind_vertex_shader(vertex_shader_t* shader)
+{
+    cmd_pointer_args_t args = { shader };
+    record(command_bind_vertex_shader, args);
+    m_vertex_shader = shader;
+}
+
+
+void command_buffer_t::record_bind_pixel_shader(pixel_shader_t* shader)
+{
+    cmd_pointer_args_t args = { shader };
+    record(command_bind_pixel_shader, args);
+    m_pixel_shader = shader;
+}
+
+
+void command_buffer_t::record_bind_pipeline_state(pipeline_state_t pipeline_state)
+{
+    const pipeline_state_object_t* pso = (const pipeline_state_object_t*)pipeline_state;
+    cmd_resource_args_t args = { pipeline_state };
+    record(command_bind_pipeline_state, args);
+    m_vertex_shader = pso->desc.vertex_shader;
+    m_pixel_shader = pso->desc.pixel_shader;
+}
+
+
+void command_buffer_t::record_bind_const_buffer(uint32_t slot, resource_t resource)
+{
+    // The bind itself is recorded by the next draw, along with the version it reads.
+    m_const_buffers[slot] = resource;
+    m_dirty_const_buffers |= 1u << slot;
+    m_bound_const_buffers |= 1u << slot;
+}
+
+
+void command_buffer_t::record_draw_state()
+{
+    record_shader_snapshots();
+    record_const_buffer_versions();
+}
+
+
+void command_buffer_t::reference_block(const_block_t* block)
+{
+    for (const_block_t* referenced : m_blocks)
+    {
+        if (referenced == block)
+        {
+            return;
+        }
+    }
+    block->references.fetch_add(1, std::memory_order_relaxed);
+    m_blocks.push_back(block);
+}
+
+
+// A discard on another thread may retire, and recycle, the block of the version at any point until it is
+// referenced. The block is only valid if the version is still current once read, and the version only once
+// referenced, if it is still current then. Otherwise the newer version is taken.
+uintptr_t command_buffer_t::reference_version(resource_t resource, uintptr_t version)
+{
+    const_buffer_header_t* header = resource ? get_const_buffer_header(resource) : nullptr;
+    while (header)
+    {
+        const_block_t* block = get_version_block(resource, version);
+        uintptr_t current = header->version.load(std::memory_order_acquire);
+        if (current == version && block)
+        {
+            reference_block(block);
+            current = header->version.load(std::memory_order_acquire);
+        }
+        if (current == version)
+        {
+            break;
+        }
+        version = current;
+    }
+    return version;
+}
+
+
+// Only versions are recorded, never the contents, so unchanged constant buffers cost nothing per draw.
+void command_buffer_t::record_const_buffer_versions()
+{
+    for (uint32_t slot = 0; slot < SWRAST_MAX_CONST_BUFFERS; ++slot)
+    {
+        const resource_t resource = m_const_buffers[slot];
+        const uintptr_t version = resource ? get_const_buffer_header(resource)->version.load(std::memory_order_acquire) : 0;
+        if (version == m_recorded_versions[slot] && !(m_dirty_const_buffers & (1u << slot)))
+        {
+            continue;
+        }
+        cmd_bind_const_buffer_args_t args = { slot, resource, reference_version(resource, version) };
+        record(command_bind_const_buffer, args);
+        m_recorded_versions[slot] = args.version;
+        m_bound_const_buffers |= 1u << slot;
+    }
+    m_dirty_const_buffers = 0;
+}
+
+
+void command_buffer_t::record_shader_snapshots()
+{
+    vertex_shader_t* vertex_snapshot = m_vertex_shader ? m_vertex_snapshots.acquire(*m_vertex_shader) : nullptr;
+    if (vertex_snapshot)
+    {
+        cmd_pointer_args_t args = { vertex_snapshot };
+        record(command_bind_vertex_shader, args);
+    }
+    pixel_shader_t* pixel_snapshot = m_pixel_shader ? m_pixel_snapshots.acquire(*m_pixel_shader) : nullptr;
+    if (pixel_snapshot)
+    {
+        cmd_pointer_args_t args = { pixel_snapshot };
+        record(command_bind_pixel_shader_snapshot, args);
+    }
+}
+
+
+error_t command_buffer_t::execute() const
+{
+    error_t result = result_ok;
+    size_t offset = 0;
+    while (offset < m_data.size() && result == result_ok)
+    {
+        const uint8_t* command = &m_data[offset];
+        command_header_t header;
+        memcpy(&header, command, sizeof(header));
+        offset += header.size_bytes;
+        switch (header.type)
+        {
+            case command_set_viewports:
+            {
+                const cmd_count_args_t args = read_args<cmd_count_args_t>(command);
+                viewport_t* viewports = read_array<cmd_count_args_t, viewport_t>(command);
+                result = set_viewports(args.count, viewports);
+                break;
+            }
+            case command_set_view_instancing:
+            {
+                const cmd_set_view_instancing_args_t args = read_args<cmd_set_view_instancing_args_t>(command);
+                view_instance_location_t* locations = read_array<cmd_set_view_instancing_args_t, view_instance_location_t>(command);
+                result = set_view_instancing(args.view_count, args.has_locations ? locations : nullptr);
+                break;
+            }
+            case command_bind_render_targets:
+            {
+                const cmd_bind_render_targets_args_t args = read_args<cmd_bind_render_targets_args_t>(command);
+                resource_t* rtvs = read_array<cmd_bind_render_targets_args_t, resource_t>(command);
+                result = bind_render_targets(args.num_rtvs, rtvs, args.dsv);
+                break;
+            }
+            case command_bind_depth_stencil:
+                result = bind_depth_stencil(read_args<cmd_resource_args_t>(command).resource);
+                break;
+            case command_clear_render_target:
+            {
+                cmd_clear_render_target_args_t args = read_args<cmd_clear_render_target_args_t>(command);
+                result = clear_render_target(args.slot, args.rect, args.rgba);
+                break;
+            }
+            case command_clear_depth_stencil:
+            {
+                const cmd_clear_depth_stencil_args_t args = read_args<cmd_clear_depth_stencil_args_t>(command);
+                result = clear_depth_stencil(args.depth, args.rect);
+                break;
+            }
+            case command_bind_vertex_buffers:
+            {
+                const cmd_count_args_t args = read_args<cmd_count_args_t>(command);
+                resource_t* vbs = read_array<cmd_count_args_t, resource_t>(command);
+                result = bind_vertex_buffers(args.count, vbs);
+                break;
+            }
+            case command_bind_index_buffer:
+            {
+                const cmd_bind_index_buffer_args_t args = read_args<cmd_bind_index_buffer_args_t>(command);
+                result = bind_index_buffer(args.ib, args.format);
+                break;
+            }
+            case command_draw_instanced:
+            {
+                const cmd_draw_instanced_args_t args = read_args<cmd_draw_instanced_args_t>(command);
+                result = draw_instanced(args.num_vertices, args.instance_count, args.first_vertex, args.first_instance);
+                break;
+            }
+            case command_draw_indexed_instanced:
+            {
+                const cmd_draw_indexed_instanced_args_t args = read_args<cmd_draw_indexed_instanced_args_t>(command);
+                result = draw_indexed_instanced(args.num_indices, args.num_instances, args.first_index, args.vertex_offset, args.first_instance);
+                break;
+            }
+            case command_draw_indexed_indirect:
+            {
+                const cmd_draw_indexed_indirect_args_t args = read_args<cmd_draw_indexed_indirect_args_t>(command);
+                result = draw_indexed_indirect(args.args, args.count, args.stride);
+                break;
+            }
+            case command_draw_point_splats:
+                result = draw_point_splats(read_args<point_splat_desc_t>(command));
+                break;
+            case command_bind_vertex_shader:
+                result = bind_vertex_shader((vertex_shader_t*)read_args<cmd_pointer_args_t>(command).pointer);
+                break;
+            case command_bind_pixel_shader:
+                result = bind_pixel_shader((pixel_shader_t*)read_args<cmd_pointer_args_t>(command).pointer);
+                break;
+            case command_bind_pixel_shader_snapshot:
+                result = rebind_pixel_shader((pixel_shader_t*)read_args<cmd_pointer_args_t>(command).pointer);
+                break;
+            case command_bind_compute_shader:
+                result = bind_compute_shader((compute_shader_t*)read_args<cmd_pointer_args_t>(command).pointer);
+                break;
+            case command_dispatch:
+            {
+                const cmd_dispatch_args_t args = read_args<cmd_dispatch_args_t>(command);
+                result = dispatch(args.groups_x, args.groups_y, args.groups_z);
+                break;
+            }
+            case command_enable_depth:
+                result = enable_depth(read_args<cmd_value_args_t>(command).value != 0);
+                break;
+            case command_enable_depth_write:
+                result = enable_depth_write(read_args<cmd_value_args_t>(command).value != 0);
+                break;
+            case command_set_cull_mode:
+                result = set_cull_mode((cull_mode_t)read_args<cmd_value_args_t>(command).value);
+                break;
+            case command_set_primitive_topology:
+                result = set_primitive_topology((primitive_topology_t)read_args<cmd_value_args_t>(command).value);
+                break;
+            case command_enable_primitive_restart:
+                result = enable_primitive_restart(read_args<cmd_value_args_t>(command).value != 0);
+                break;
+            case command_set_front_face:
+                result = set_front_face((front_face_t)read_args<cmd_value_args_t>(command).value);
+                break;
+            case command_set_line_width:
+                result = set_line_width(read_args<cmd_float_args_t>(command).value);
+                break;
+            case command_set_point_size:
+                result = set_point_size(read_args<cmd_float_args_t>(command).value);
+                break;
+            case command_set_depth_compare:
+                result = set_depth_compare((compare_op_t)read_args<cmd_value_args_t>(command).value);
+                break;
+            case command_set_input_layout:
+                result = set_input_layout((input_layout_t)read_args<cmd_resource_args_t>(command).resource);
+                break;
+            case command_bind_pipeline_state:
+                result = bind_pipeline_state((pipeline_state_t)read_args<cmd_resource_args_t>(command).resource);
+                break;
+            case command_bind_shader_resource:
+            {
+                const cmd_slot_args_t args = read_args<cmd_slot_args_t>(command);
+                result = bind_shader_resource(args.slot, args.resource);
+                break;
+            }
+            case command_visibility_pass:
+                result = read_args<cmd_value_args_t>(command).value ? begin_visibility_pass() : end_visibility_pass();
+                break;
+            case command_bind_unordered_access:
+            {
+                const cmd_slot_args_t args = read_args<cmd_slot_args_t>(command);
+                result = bind_unordered_access(args.slot, args.resource);
+                break;
+            }
+            case command_bind_const_buffer:
+            {
+                const cmd_bind_const_buffer_args_t args = read_args<cmd_bind_const_buffer_args_t>(command);
+                result = bind_const_buffer_version(args.slot, args.resource, args.version);
+                break;
+            }
+            case command_signal_fence:
+            {
+                const cmd_signal_fence_args_t args = read_args<cmd_signal_fence_args_t>(command);
+                args.fence->signal(args.value);
+                break;
+            }
+            default:
+                result = result_failed;
+                break;
+        }
+    }
+    if (!m_vertex_snapshots.empty() && m_vertex_shader)
+    {
+        bind_vertex_shader(m_vertex_shader);
+    }
+    if (!m_pixel_snapshots.empty() && m_pixel_shader)
+    {
+        rebind_pixel_shader(m_pixel_shader);
+    }
+    for (uint32_t slot = 0; slot < SWRAST_MAX_CONST_BUFFERS; ++slot)
+    {
+        if (m_bound_const_buffers & (1u << slot))
+        {
+            bind_const_buffer(slot, m_const_buffers[slot]);
+        }
+    }
+    return result;
+}
+
+
+command_list_t create_command_list()
+{
+    return (command_list_t)new command_buffer_t();
+}
+
+
+error_t destroy_command_list(command_list_t command_list)
+{
+    delete (command_buffer_t*)command_list;
+    return result_ok;
+}
+
+
+error_t reset_command_list(command_list_t command_list)
+{
+    ((command_buffer_t*)command_list)->reset();
+    return result_ok;
+}
+
+
+error_t cmd_set_viewports(command_list_t command_list, uint32_t count, viewport_t* viewports)
+{
+    if (count > SWRAST_MAX_VIEWPORTS)
+    {
+        return result_failed;
+    }
+    cmd_count_args_t args = { count };
+    ((command_buffer_t*)command_list)->record(command_set_viewports, args, viewports, count * sizeof(viewport_t));
+    return result_ok;
+}
+
+
+error_t cmd_set_view_instancing(command_list_t command_list, uint32_t view_count, view_instance_location_t* locations)
+{
+    if (view_count > SWRAST_MAX_VIEW_INSTANCES)
+    {
+        return result_failed;
+    }
+    cmd_set_view_instancing_args_t args = { view_count, locations ? 1u : 0u };
+    const uint32_t num_locations = locations ? view_count : 0;
+    ((command_buffer_t*)command_list)->record(command_set_view_instancing, args, locations, num_locations * sizeof(view_instance_location_t));
+    return result_ok;
+}
+
+
+error_t cmd_bind_render_targets(command_list_t command_list, uint32_t num_rtvs, resource_t* rtvs, resource_t dsv)
+{
+    cmd_bind_render_targets_args_t args = { num_rtvs, dsv };
+    ((command_buffer_t*)command_list)->record(command_bind_render_targets, args, rtvs, num_rtvs * sizeof(resource_t));
+    return result_ok;
+}
+
+
+error_t cmd_bind_depth_stencil(command_list_t command_list, resource_t ds)
+{
+    cmd_resource_args_t args = { ds };
+    ((command_buffer_t*)command_list)->record(command_bind_depth_stencil, args);
+    return result_ok;
+}
+
+
+error_t cmd_clear_render_target(command_list_t command_list, uint32_t slot, const rect_t& rect, float* rgba)
+{
+    cmd_clear_render_target_args_t args = { slot, rect, { rgba[0], rgba[1], rgba[2], rgba[3] } };
+    ((command_buffer_t*)command_list)->record(command_clear_render_target, args);
+    return result_ok;
+}
+
+
+error_t cmd_clear_depth_stencil(command_list_t command_list, float depth, const rect_t& rect)
+{
+    cmd_clear_depth_stencil_args_t args = { depth, rect };
+    ((command_buffer_t*)command_list)->record(command_clear_depth_stencil, args);
+    return result_ok;
+}
+
+
+error_t cmd_bind_vertex_buffers(command_list_t command_list, uint32_t num_vbs, resource_t* vbs)
+{
+    cmd_count_args_t args = { num_vbs };
+    ((command_buffer_t*)command_list)->record(command_bind_vertex_buffers, args, vbs, num_vbs * sizeof(resource_t));
+    return result_ok;
+}
+
+
+error_t cmd_bind_index_buffer(command_list_t command_list, resource_t ib, format_t format)
+{
+    cmd_bind_index_buffer_args_t args = { ib, format };
+    ((command_buffer_t*)command_list)->record(command_bind_index_buffer, args);
+    return result_ok;
+}
+
+
+error_t cmd_draw_instanced(command_list_t command_list, uint32_t num_vertices, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
+{
+    cmd_draw_instanced_args_t args = { num_vertices, instance_count, first_vertex, first_instance };
+    ((command_buffer_t*)command_list)->record_draw_state();
+    ((command_buffer_t*)command_list)->record(command_draw_instanced, args);
+    return result_ok;
+}
+
+
+error_t cmd_draw_indexed_instanced(command_list_t command_list, uint32_t num_indices, uint32_t num_instances, uint32_t first_index, uint32_t vertex_offset, uint32_t first_instance)
+{
+    cmd_draw_indexed_instanced_args_t args = { num_indices, num_instances, first_index, vertex_offset, first_instance };
+    ((command_buffer_t*)command_list)->record_draw_state();
+    ((command_buffer_t*)command_list)->record(command_draw_indexed_instanced, args);
+    return result_ok;
+}
+
+
+error_t cmd_draw_indexed_indirect(command_list_t command_list, resource_t args, uint32_t count, uint32_t stride)
+{
+    cmd_draw_indexed_indirect_args_t indirect_args = { args, count, stride };
+    ((command_buffer_t*)command_list)->record_draw_state();
+    ((command_buffer_t*)command_list)->record(command_draw_indexed_indirect, indirect_args);
+    return result_ok;
+}
+
+
+error_t cmd_draw_point_splats(command_list_t command_list, const point_splat_desc_t& desc)
+{
+    ((command_buffer_t*)command_list)->record(command_draw_point_splats, desc);
+    return result_ok;
+}
+
+
+error_t cmd_begin_visibility_pass(command_list_t command_list)
+{
+    cmd_value_args_t args = { 1 };
+    ((command_buffer_t*)command_list)->record(command_visibility_pass, args);
+    return result_ok;
+}
+
+
+error_t cmd_end_visibility_pass(command_list_t command_list)
+{
+    cmd_value_args_t args = { 0 };
+    ((command_buffer_t*)command_list)->record(command_visibility_pass, args);
+    return result_ok;
+}
+
+
+error_t cmd_bind_vertex_shader(command_list_t command_list, vertex_shader_t* vs)
+{
+    ((command_buffer_t*)command_list)->record_bind_vertex_shader(vs);
+    return result_ok;
+}
+
+
+error_t cmd_bind_pixel_shader(command_list_t command_list, pixel_shader_t* ps)
+{
+    ((command_buffer_t*)command_list)->record_bind_pixel_shader(ps);
+    return result_ok;
+}
+
+
+error_t cmd_bind_compute_shader(command_list_t command_list, compute_shader_t* cs)
+{
+    cmd_pointer_args_t args = { cs };
+    ((command_buffer_t*)command_list)->record(command_bind_compute_shader, args);
+    return result_ok;
+}
+
+
+error_t cmd_dispatch(command_list_t command_list, uint32_t groups_x, uint32_t groups_y, uint32_t groups_z)
+{
+    cmd_dispatch_args_t args = { groups_x, groups_y, groups_z };
+    ((command_buffer_t*)command_list)->record_dispatch_state();
+    ((command_buffer_t*)command_list)->record(command_dispatch, args);
+    return result_ok;
+}
+
+
+error_t cmd_bind_pipeline_state(command_list_t command_list, pipeline_state_t pipeline_state)
+{
+    if (!pipeline_state)
+    {
+        return result_failed;
+    }
+    ((command_buffer_t*)command_list)->record_bind_pipeline_state(pipeline_state);
+    return result_ok;
+}
+
+
+error_t cmd_bind_shader_resource(command_list_t command_list, uint32_t slot, resource_t resource)
+{
+    if (slot >= SWRAST_MAX_SHADER_RESOURCES)
+    {
+        return result_failed;
+    }
+    cmd_slot_args_t args = { slot, resource };
+    ((command_buffer_t*)command_list)->record(command_bind_shader_resource, args);
+    return result_ok;
+}
+
+
+error_t cmd_bind_unordered_access(command_list_t command_list, uint32_t slot, resource_t resource)
+{
+    if (slot >= SWRAST_MAX_UNORDERED_ACCESS_VIEWS)
+    {
+        return result_failed;
+    }
+    cmd_slot_args_t args = { slot, resource };
+    ((command_buffer_t*)command_list)->record(command_bind_unordered_access, args);
+    return result_ok;
+}
+
+
+error_t cmd_bind_const_buffer(command_list_t command_list, uint32_t slot, resource_t resource)
+{
+    if (slot >= SWRAST_MAX_CONST_BUFFERS)
+    {
+        return result_failed;
+    }
+    ((command_buffer_t*)command_list)->record_bind_const_buffer(slot, resource);
+    return result_ok;
+}
+
+
+// Commands carrying a single value.
+static error_t record_value(command_list_t command_list, command_type_t type, uint32_t value)
+{
+    cmd_value_args_t args = { value };
+    ((command_buffer_t*)command_list)->record(type, args);
+    return result_ok;
+}
+
+
+static error_t record_float(command_list_t command_list, command_type_t type, float value)
+{
+    cmd_float_args_t args = { value };
+    ((command_buffer_t*)command_list)->record(type, args);
+    return result_ok;
+}
+
+
+error_t cmd_enable_depth(command_list_t command_list, bool enable)
+{
+    return record_value(command_list, command_enable_depth, enable ? 1 : 0);
+}
+
+
+error_t cmd_enable_depth_write(command_list_t command_list, bool enable)
+{
+    return record_value(command_list, command_enable_depth_write, enable ? 1 : 0);
+}
+
+
+error_t cmd_set_cull_mode(command_list_t command_list, cull_mode_t cull_mode)
+{
+    return record_value(command_list, command_set_cull_mode, cull_mode);
+}
+
+
+error_t cmd_set_primitive_topology(command_list_t command_list, primitive_topology_t primitive_topology)
+{
+    return record_value(command_list, command_set_primitive_topology, primitive_topology);
+}
+
+
+error_t cmd_enable_primitive_restart(command_list_t command_list, bool enable)
+{
+    return record_value(command_list, command_enable_primitive_restart, enable ? 1 : 0);
+}
+
+
+error_t cmd_set_front_face(command_list_t command_list, front_face_t front_face)
+{
+    return record_value(command_list, command_set_front_face, front_face);
+}
+
+
+error_t cmd_set_line_width(command_list_t command_list, float width)
+{
+    return record_float(command_list, command_set_line_width, width);
+}
+
+
+error_t cmd_set_point_size(command_list_t command_list, float size)
+{
+    return record_float(command_list, command_set_point_size, size);
+}
+
+
+error_t cmd_set_depth_compare(command_list_t command_list, compare_op_t compare_op)
+{
+    return record_value(command_list, command_set_depth_compare, compare_op);
+}
+
+
+error_t cmd_set_input_layout(command_list_t command_list, input_layout_t layout)
+{
+    cmd_resource_args_t args = { layout };
+    ((command_buffer_t*)command_list)->record(command_set_input_layout, args);
+    return result_ok;
+}
+
+
+error_t cmd_signal_fence(command_list_t command_list, fence_t fence, uint64_t value)
+{
+    cmd_signal_fence_args_t args = { (fence_object_t*)fence, value };
+    ((command_buffer_t*)command_list)->record(command_signal_fence, args);
+    return result_ok;
+}
+} // swrast
@@ -0,0 +1,152 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "ConstantRing.hpp"
+#include "ShaderSnapshots.hpp"
+
+#include <cstring>
+#include <vector>
+
+namespace swrast {
+
+
+enum command_type_t
+{
+    command_set_viewports,
+    command_set_view_instancing,
+    command_bind_render_targets,
+    command_bind_depth_stencil,
+    command_clear_render_target,
+    command_clear_depth_stencil,
+    command_bind_vertex_buffers,
+    command_bind_index_buffer,
+    command_draw_instanced,
+    command_draw_indexed_instanced,
+    command_draw_indexed_indirect,
+    command_draw_point_splats,
+    command_bind_vertex_shader,
+    command_bind_pixel_shader,
+    command_bind_pixel_shader_snapshot,
+    command_bind_compute_shader,
+    command_dispatch,
+    command_enable_depth,
+    command_enable_depth_write,
+    command_set_cull_mode,
+    command_set_primitive_topology,
+    command_enable_primitive_restart,
+    command_set_front_face,
+    command_set_line_width,
+    command_set_point_size,
+    command_set_depth_compare,
+    command_set_input_layout,
+    command_bind_shader_resource,
+    command_bind_const_buffer,
+    command_bind_unordered_access,
+    command_visibility_pass,
+    command_bind_pipeline_state,
+    command_signal_fence
+};
+
+
+// Every command starts with a header, followed by its arguments, and any variable sized data (viewports, 
+// resources...). Arguments and data both start 8 byte aligned. size_bytes covers all of it, and keeps the next 
+// header aligned too.
+struct command_header_t
+{
+    uint32_t type;
+    uint32_t size_bytes;
+};
+
+
+// Compact binary recording of state changes and draws. Recording only touches the command buffer, so 
+// separate command buffers can be recorded on separate threads. Executing replays the commands in order, 
+// against the context.
+// Draws run with snapshots of the shaders bound when they were recorded, for shaders that can be cloned. 
+// Snapshots are owned by the command buffer, and live until it is reset, after which they are recycled.
+// Likewise, draws read the versions of the constant buffers current when they were recorded. The command 
+// buffer references the blocks holding those versions until it is reset, so they are not recycled.
+class command_buffer_t
+{
+public:
+    ~command_buffer_t() { reset(); }
+
+    void reset();
+    // Append every command of another command buffer. Its shader snapshots are copied, so it can be reset right after.
+    void append(const command_buffer_t& commands);
+    // Shaders and constant buffers bound before the first recorded command, used until the commands bind their own.
+    void inherit_bindings(vertex_shader_t* vertex_shader, pixel_shader_t* pixel_shader, const resource_t* const_buffers);
+
+    vertex_shader_t* get_vertex_shader() const { return m_vertex_shader; }
+    pixel_shader_t* get_pixel_shader() const { return m_pixel_shader; }
+    const resource_t* get_const_buffers() const { return m_const_buffers; }
+
+    void record_bind_vertex_shader(vertex_shader_t* shader);
+    void record_bind_pixel_shader(pixel_shader_t* shader);
+    void record_bind_const_buffer(uint32_t slot, resource_t resource);
+    void record_bind_pipeline_state(pipeline_state_t pipeline_state);
+    // Record what the next draw reads: snapshots of the current shaders, and the current versions of the 
+    // constant buffers, the ones that changed since the last draw.
+    void record_draw_state();
+    // Dispatches only read constant buffers, compute shaders are not snapshot.
+    void record_dispatch_state() { record_const_buffer_versions(); }
+
+    template<typename args_t>
+    void record(command_type_t type, const args_t& args, const void* data = nullptr, uint32_t data_size_bytes = 0)
+    {
+        const uint32_t size_bytes = get_data_offset<args_t>() + align_up(data_size_bytes);
+        const size_t offset = m_data.size();
+        m_data.resize(offset + size_bytes);
+        command_header_t header = { };
+        header.type = type;
+        header.size_bytes = size_bytes;
+        memcpy(&m_data[offset], &header, sizeof(header));
+        memcpy(&m_data[offset + sizeof(header)], &args, sizeof(args_t));
+        if (data_size_bytes)
+        {
+            memcpy(&m_data[offset + get_data_offset<args_t>()], data, data_size_bytes);
+        }
+    }
+
+    // Once done, the original shaders and constant buffers are bound back, so the context never keeps a 
+    // snapshot, or an old version, bound.
+    error_t execute() const;
+
+    size_t get_size_bytes() const { return m_data.size(); }
+
+    // Offset of the variable sized data, from the start of the command.
+    template<typename args_t>
+    static uint32_t get_data_offset() { return sizeof(command_header_t) + align_up(sizeof(args_t)); }
+
+private:
+    static uint32_t align_up(size_t size_bytes) { return (uint32_t)((size_bytes + 7) & ~(size_t)7); }
+
+    void record_shader_snapshots();
+    void record_const_buffer_versions();
+    void reference_block(const_block_t* block);
+    // Reference the block of a version of the constant buffer, returns the version to record.
+    uintptr_t reference_version(resource_t resource, uintptr_t version);
+
+    std::vector<uint8_t>            m_data;
+    // Shaders bound, as of the last recorded command.
+    vertex_shader_t*                m_vertex_shader = nullptr;
+    pixel_shader_t*                 m_pixel_shader = nullptr;
+    shader_snapshots_t<vertex_shader_t> m_vertex_snapshots;
+    shader_snapshots_t<pixel_shader_t>  m_pixel_snapshots;
+    // Constant buffers bound, as of the last recorded command, and the versions last recorded for draws.
+    resource_t                      m_const_buffers[SWRAST_MAX_CONST_BUFFERS] = { };
+    uintptr_t                       m_recorded_versions[SWRAST_MAX_CONST_BUFFERS] = { };
+    // Slots bound since the last draw, and every slot the commands bind.
+    uint32_t                        m_dirty_const_buffers = 0;
+    uint32_t                        m_bound_const_buffers = 0;
+    std::vector<const_block_t*>     m_blocks;
+};
+
+
+// Replays a constant buffer bind, with the version recorded for the following draws. Lives in Context.cpp, 
+// along with the other entry points.
+error_t bind_const_buffer_version(uint32_t slot, resource_t resource, uintptr_t version);
+// Replays the bind of a pixel shader snapshot, or of the shader it was snapshot from. They share the varyings of the 
+// bound shader, so its interpolator layout is kept.
+error_t rebind_pixel_shader(pixel_shader_t* shader);
+} // swrast
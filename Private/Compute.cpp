@@ -0,0 +1,91 @@
+//
+#include "Compute.hpp"
+
+namespace swrast {
+
+
+error_t compute_dispatcher_t::release()
+{
+    m_scratch.release();
+    m_scratch_stride = 0;
+    return result_ok;
+}
+
+
+static uint64_t align_scratch(uint64_t size_bytes)
+{
+    return (size_bytes + 15) & ~15ull;
+}
+
+
+error_t compute_dispatcher_t::dispatch(compute_shader_t& shader, uint32_t groups_x, uint32_t groups_y, uint32_t groups_z)
+{
+    const uint32_t threads_per_group = shader.get_group_thread_count();
+    if (!threads_per_group || threads_per_group > SWRAST_MAX_COMPUTE_GROUP_THREADS || 
+        shader.get_group_shared_size_bytes() > SWRAST_MAX_GROUP_SHARED_SIZE_BYTES)
+    {
+        return result_failed;
+    }
+    const uint64_t num_groups = (uint64_t)groups_x * groups_y * groups_z;
+    if (!num_groups)
+    {
+        return result_ok;
+    }
+    if (num_groups > UINT32_MAX)
+    {
+        return result_failed;
+    }
+
+    // Group shared memory first, then the thread local memory of every thread of the group.
+    m_scratch_stride = align_scratch(shader.get_group_shared_size_bytes()) + 
+        align_scratch(shader.get_thread_local_size_bytes()) * threads_per_group;
+    const uint64_t scratch_size = m_scratch_stride * m_job_system->get_num_thread_indices();
+    if (scratch_size > m_scratch.get_memory_size_bytes())
+    {
+        m_scratch.preallocate(scratch_size);
+    }
+
+    const uint32_t groups_per_job = maximum<uint32_t>(1u, SWRAST_COMPUTE_THREADS_PER_JOB / threads_per_group);
+    m_job_system->parallel_for((uint32_t)num_groups, groups_per_job, [&] (uint32_t begin, uint32_t end)
+    {
+        const uintptr_t scratch = m_scratch.get_base_address() + m_scratch_stride * job_system_t::get_thread_index();
+        for (uint32_t group_i = begin; group_i < end; ++group_i)
+        {
+            const uint3_t group_id(group_i % groups_x, (group_i / groups_x) % groups_y, group_i / (groups_x * groups_y));
+            run_group(shader, group_id, scratch);
+        }
+    });
+    return result_ok;
+}
+
+
+void compute_dispatcher_t::run_group(compute_shader_t& shader, const uint3_t& group_id, uintptr_t scratch)
+{
+    const uint3_t group_size = shader.get_group_size();
+    const uint64_t thread_local_stride = align_scratch(shader.get_thread_local_size_bytes());
+    compute_thread_t thread = { };
+    thread.group_id = group_id;
+    thread.group_shared = scratch;
+    const uintptr_t thread_local_base = scratch + align_scratch(shader.get_group_shared_size_bytes());
+
+    // Barriers are the boundaries between phases, the whole group finishes a phase before moving on.
+    for (uint32_t phase = 0; phase <= shader.get_barrier_count(); ++phase)
+    {
+        thread.group_index = 0;
+        for (uint32_t z = 0; z < group_size.z; ++z)
+        {
+            for (uint32_t y = 0; y < group_size.y; ++y)
+            {
+                for (uint32_t x = 0; x < group_size.x; ++x)
+                {
+                    thread.group_thread_id = uint3_t(x, y, z);
+                    thread.dispatch_thread_id = uint3_t(group_id.x * group_size.x + x, group_id.y * group_size.y + y, group_id.z * group_size.z + z);
+                    thread.thread_local_memory = thread_local_base + thread.group_index * thread_local_stride;
+                    shader.execute(thread, phase);
+                    ++thread.group_index;
+                }
+            }
+        }
+    }
+}
+} // swrast
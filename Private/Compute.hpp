@@ -0,0 +1,34 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "JobSystem.hpp"
+#include "Memory.hpp"
+
+namespace swrast {
+
+
+// Threads run by a single job, at least one group.
+#define SWRAST_COMPUTE_THREADS_PER_JOB 1024
+
+
+// Runs compute dispatches on the job system. Groups are independent, and spread across jobs. A group runs on 
+// a single thread, phase after phase, so barriers between phases cost nothing, and group shared memory is 
+// scratch memory of the thread running the group.
+class compute_dispatcher_t
+{
+public:
+    error_t initialize(job_system_t* job_system) { m_job_system = job_system; return result_ok; }
+    error_t release();
+
+    error_t dispatch(compute_shader_t& shader, uint32_t groups_x, uint32_t groups_y, uint32_t groups_z);
+
+private:
+    void run_group(compute_shader_t& shader, const uint3_t& group_id, uintptr_t scratch);
+
+    // Group shared, and thread local, memory of each thread that may run groups.
+    memory_pool_t   m_scratch;
+    uint64_t        m_scratch_stride = 0;
+    job_system_t*   m_job_system = nullptr;
+};
+} // swrast
@@ -0,0 +1,51 @@
+//
+#include "ConstantRing.hpp"
+
+namespace swrast {
+
+
+void constant_ring_t::release()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const_block_t* block : m_blocks)
+    {
+        delete block;
+    }
+    m_blocks.clear();
+    m_current = nullptr;
+    m_offset = 0;
+}
+
+
+uintptr_t constant_ring_t::allocate(uint32_t size_bytes)
+{
+    size_bytes = ((size_bytes + 15) & ~15u) + SWRAST_CONST_RING_PREFIX_SIZE_BYTES;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_current || m_offset + size_bytes > m_current->memory.get_memory_size_bytes())
+    {
+        // Retire the current block, and move on to one nothing reads from anymore.
+        m_current = nullptr;
+        for (const_block_t* candidate : m_blocks)
+        {
+            if (candidate->references.load(std::memory_order_acquire) == 0 &&
+                candidate->memory.get_memory_size_bytes() >= size_bytes)
+            {
+                m_current = candidate;
+                break;
+            }
+        }
+        if (!m_current)
+        {
+            m_current = new const_block_t();
+            m_current->memory.preallocate(size_bytes > SWRAST_CONST_RING_BLOCK_SIZE_BYTES ? size_bytes : SWRAST_CONST_RING_BLOCK_SIZE_BYTES);
+            m_blocks.push_back(m_current);
+        }
+        m_offset = 0;
+    }
+    const uintptr_t prefix = m_current->memory.get_base_address() + m_offset;
+    m_offset += size_bytes;
+    *(const_block_t**)prefix = m_current;
+    m_current->references.fetch_add(1, std::memory_order_relaxed);
+    return prefix + SWRAST_CONST_RING_PREFIX_SIZE_BYTES;
+}
+} // swrast
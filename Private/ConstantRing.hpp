@@ -0,0 +1,72 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "Memory.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace swrast {
+
+
+// Size of the blocks versions of constant buffers are allocated from. Larger buffers get a block of their own.
+#define SWRAST_CONST_RING_BLOCK_SIZE_BYTES (64 * 1024)
+// Versions allocated by the ring are preceded by a pointer to their block, padded to keep versions 16 byte aligned.
+#define SWRAST_CONST_RING_PREFIX_SIZE_BYTES 16
+
+
+// Block of constant buffer versions. References count the buffers whose current version lives in the block,
+// and the command buffers holding draws that read from it. Once retired by the ring, a block without
+// references is recycled.
+struct const_block_t
+{
+    memory_pool_t           memory;
+    std::atomic<uint32_t>   references{ 0 };
+};
+
+
+// Constant buffers keep their current version in front of their resource description. Until mapped with
+// discard, the current version is the memory of the resource itself, without a block. The block of a version
+// is found from the version, so discards publish both with a single atomic, while other threads record
+// command lists reading them.
+struct alignas(16) const_buffer_header_t
+{
+    std::atomic<uintptr_t> version;
+};
+
+
+inline const_buffer_header_t* get_const_buffer_header(resource_t resource)
+{
+    return (const_buffer_header_t*)(resource - sizeof(resource_desc_t) - sizeof(const_buffer_header_t));
+}
+
+
+// Block holding a version of the constant buffer, nullptr for the memory of the resource itself.
+inline const_block_t* get_version_block(resource_t resource, uintptr_t version)
+{
+    return version == resource ? nullptr : *(const_block_t**)(version - SWRAST_CONST_RING_PREFIX_SIZE_BYTES);
+}
+
+
+// Allocates versions of constant buffers. Versions are carved out of the current block, one after the other,
+// and are never written by the ring once handed out, so draws can keep reading an old version while the
+// application writes the next one. Every thread mapping with discard shares the ring, allocations are locked.
+class constant_ring_t
+{
+public:
+    ~constant_ring_t() { release(); }
+
+    void release();
+    // Allocate a version, 16 byte aligned. A reference to the block holding it is taken for the caller, before
+    // another allocation can retire the block.
+    uintptr_t allocate(uint32_t size_bytes);
+
+private:
+    std::mutex                  m_mutex;
+    std::vector<const_block_t*> m_blocks;
+    const_block_t*              m_current = nullptr;
+    uint32_t                    m_offset = 0;
+};
+} // swrast
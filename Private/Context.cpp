@@ -1,50 +1,228 @@
 // 
 #include "Context.hpp"
-#include "InputAssembly.hpp"
-#include "Rasterizer.hpp"
-#include "HardwareShader.hpp"
+#include "RenderContext.hpp"
 #include "Memory.hpp"
-#include "Allocator.hpp"
+#include "FormatConversion.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <thread>
 
 namespace swrast {
 
-hardware_shader_cache_t shader_cache;
-input_assembler_t       assembler;
-vertex_transformation_t vertex_transformation;
-clipper_t               clipper;
-rasterizer_t            rasterizer;
-primitive_topology_t    bound_primitive_topology;
-allocator_t*            resource_allocator;
-front_face_t            winding_order;
+// Context created by initialize(). Threads without a current context of their own use it.
+render_context_t*                       default_context;
+static thread_local render_context_t*   t_current_context;
 
-error_t initialize()
+
+static render_context_t& current_context()
+{
+    return t_current_context ? *t_current_context : *default_context;
+}
+
+
+// With async submission, entry points called by the application record into the pending commands, 
+// the submission queue thread then replays them, and executes them for real.
+static bool record_to_queue(render_context_t& ctx)
+{
+    return ctx.submission_queue.is_running() && !submission_queue_t::is_queue_thread();
+}
+
+
+static command_list_t queued_commands(render_context_t& ctx)
+{
+    if (!ctx.pending_commands)
+    {
+        ctx.pending_commands = ctx.submission_queue.acquire_buffer();
+        ctx.pending_commands->inherit_bindings(ctx.queued_vertex_shader, ctx.queued_pixel_shader, ctx.queued_const_buffers);
+    }
+    return (command_list_t)ctx.pending_commands;
+}
+
+
+static void flush_pending_commands(render_context_t& ctx)
+{
+    if (ctx.pending_commands)
+    {
+        ctx.submission_queue.push(ctx.pending_commands);
+        ctx.pending_commands = nullptr;
+    }
+}
+
+
+// Called after recording work. Hands it over right away if the queue thread has nothing to do, otherwise 
+// keeps recording, so it picks up larger chunks at once.
+static error_t kick_queue(render_context_t& ctx, error_t result)
+{
+    if (ctx.submission_queue.is_idle() || ctx.pending_commands->get_size_bytes() >= SWRAST_QUEUE_KICK_SIZE_BYTES)
+    {
+        flush_pending_commands(ctx);
+    }
+    return result;
+}
+
+
+// Block until every command recorded so far has executed.
+static void finish_queue(render_context_t& ctx)
+{
+    if (record_to_queue(ctx))
+    {
+        flush_pending_commands(ctx);
+        ctx.submission_queue.wait_idle();
+    }
+}
+
+
+// Set up a context. The calling thread takes part in the work, on top of the workers.
+static error_t initialize_context(render_context_t& ctx, const context_desc_t& desc)
 {
     fbounds3d_t ndc = { };
     ndc.minima = float3_t(-1, -1, -1);
     ndc.maxima = float3_t(1, 1, 1);
-    assembler.initialize();
-    vertex_transformation.initialize();
-    clipper.initialize();
-    rasterizer.initialize(ndc);
-    resource_allocator = new malloc_allocator_t();
+    ctx.job_system.initialize(desc.num_worker_threads, desc.thread_affinity);
+    ctx.assembler.initialize();
+    ctx.vertex_transformation.initialize(&ctx.job_system);
+    ctx.clipper.initialize();
+    ctx.rasterizer.initialize(ndc, &ctx.job_system);
+    ctx.point_splatter.initialize(&ctx.job_system);
+    ctx.compute_dispatcher.initialize(&ctx.job_system);
+    ctx.geometry_pipeline.initialize(&ctx.vertex_transformation, &ctx.clipper, &ctx.primitive_assembler, &ctx.job_system);
+    ctx.resource_allocator = new malloc_allocator_t();
+    if (desc.async_submission)
+    {
+        ctx.submission_queue.initialize((context_t)&ctx);
+    }
     return result_ok;
 }
 
 
+static error_t release_context(render_context_t& ctx)
+{
+    finish_queue(ctx);
+    ctx.submission_queue.release();
+    ctx.visibility_buffer.release();
+    ctx.constant_ring.release();
+    ctx.geometry_pipeline.release();
+    delete ctx.resource_allocator;
+    ctx.assembler.release();
+    ctx.primitive_assembler.release();
+    ctx.vertex_transformation.release();
+    ctx.clipper.release();
+    ctx.rasterizer.release();
+    ctx.point_splatter.release();
+    ctx.compute_dispatcher.release();
+    ctx.job_system.release();
+    return result_ok;
+}
+
+
+error_t initialize()
+{
+    // The calling thread takes part in the work, so leave one core for it.
+    const uint32_t num_cores = std::thread::hardware_concurrency();
+    return initialize(num_cores > 1 ? num_cores - 1 : 0);
+}
+
+
+error_t initialize(uint32_t num_worker_threads)
+{
+    context_desc_t desc = { };
+    desc.num_worker_threads = num_worker_threads;
+    desc.thread_affinity = thread_affinity_none;
+    return initialize(desc);
+}
+
+
+void* render_context_t::operator new(size_t size_bytes)
+{
+    // Over allocate, and keep the address malloc returned right in front of the aligned context.
+    const uintptr_t alignment = alignof(render_context_t) > sizeof(void*) ? alignof(render_context_t) : sizeof(void*);
+    void* base = malloc(size_bytes + alignment + sizeof(void*));
+    if (!base)
+    {
+        throw std::bad_alloc();
+    }
+    const uintptr_t address = ((uintptr_t)base + sizeof(void*) + alignment - 1) & ~(alignment - 1);
+    ((void**)address)[-1] = base;
+    return (void*)address;
+}
+
+
+void render_context_t::operator delete(void* ptr)
+{
+    if (ptr)
+    {
+        free(((void**)ptr)[-1]);
+    }
+}
+
+
+error_t initialize(const context_desc_t& desc)
+{
+    if (default_context)
+    {
+        return result_failed;
+    }
+    default_context = new render_context_t();
+    return initialize_context(*default_context, desc);
+}
+
+
 error_t destroy()
 {
-    delete resource_allocator;
-    assembler.release();
-    vertex_transformation.release();
-    clipper.release();
-    rasterizer.release();
+    if (!default_context)
+    {
+        return result_failed;
+    }
+    release_context(*default_context);
+    delete default_context;
+    default_context = nullptr;
     return result_ok;
 }
 
 
+context_t create_context(const context_desc_t& desc)
+{
+    render_context_t* ctx = new render_context_t();
+    initialize_context(*ctx, desc);
+    return (context_t)ctx;
+}
+
+
+error_t destroy_context(context_t context)
+{
+    render_context_t* ctx = (render_context_t*)context;
+    if (!ctx || ctx == default_context)
+    {
+        return result_failed;
+    }
+    if (t_current_context == ctx)
+    {
+        t_current_context = nullptr;
+    }
+    release_context(*ctx);
+    delete ctx;
+    return result_ok;
+}
+
+
+error_t set_current_context(context_t context)
+{
+    t_current_context = (render_context_t*)context;
+    return result_ok;
+}
+
+
+context_t get_current_context()
+{
+    return (context_t)&current_context();
+}
+
+
 shader_t create_shader(shader_type_t type, void* src_code, uint32_t size_bytes)
 {
-    hardware_shader_t* shader_ptr = shader_cache.allocate_shader(type);
+    render_context_t& ctx = current_context();
+    hardware_shader_t* shader_ptr = ctx.shader_cache.allocate_shader(type);
     if (shader_ptr)
     {
         switch (type)
@@ -64,118 +242,446 @@ shader_t create_shader(shader_type_t type, void* src_code, uint32_t size_bytes)
 }
 
 
-error_t draw_instanced(uint32_t num_vertices, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
+static uint64_t resource_size_bytes(const resource_desc_t& desc)
 {
-    vertices_t vertex_pool = assembler.get_available_vertex_pool(UINT16_MAX * instance_count, 
-        vertex_transformation.get_vertex_shader()->get_out_vertex_stride());
-    // number of vertices called by draw call.
-    vertex_pool.num_vertices = num_vertices;
+    return (uint64_t)desc.width * desc.height * desc.depth_or_array_size * desc.mip_count * format_size_bytes(desc.format);
+}
 
-    // transform our vertices with the provided vertex shader.
-    vertex_transformation.transform(&vertex_pool, first_vertex, num_vertices);
 
-    // The clipper clips any vertices that won't be in the clip/view volume.
-    // If all vertices of the triangle are clipped, then that triangle is considered culled.
-    clipper.clip_cull(&vertex_pool);
-    
-    // Primitive generator creates our triangles.
-    // In this case, we can just reinterpret our vertices as triangles.
-    uint32_t num_triangles = vertex_pool.num_vertices / 3;
+// Resolve the constant buffer versions the shaders read.
+static void resolve_const_buffers(render_context_t& ctx)
+{
+    for (uint32_t slot = 0; slot < SWRAST_MAX_CONST_BUFFERS; ++slot)
+    {
+        uintptr_t version = ctx.const_buffer_versions[slot];
+        if (!version && ctx.const_buffers[slot])
+        {
+            version = get_const_buffer_header(ctx.const_buffers[slot])->version.load(std::memory_order_acquire);
+        }
+        ctx.draw_bindings.const_buffers[slot] = (const void*)version;
+    }
+}
+
 
-    // finally rasterize onto framebuffer. Triangles are left in clip space,
-    // so the rasterizer will convert them into ndc, for which they will then 
-    // be projected into screen space.
-    rasterizer.raster(num_triangles, vertex_pool, winding_order);
+// Shade everything drawn in the visibility pass so far. Done before anything that touches the render targets
+// other than a triangle draw, so the pass keeps the order of the commands.
+static void resolve_visibility(render_context_t& ctx)
+{
+    if (ctx.visibility_buffer.is_active() && !ctx.visibility_buffer.is_empty())
+    {
+        ctx.rasterizer.resolve_visibility();
+        ctx.visibility_buffer.reset();
+    }
+}
+
+
+// Hand the bindings to the shaders of the draw. Done once per draw call, indirect draws all share them.
+// In visibility passes, the pixel shader and its bindings are kept for when the pass is resolved.
+static error_t bind_draw_resources(render_context_t& ctx)
+{
+    resolve_const_buffers(ctx);
+    if (ctx.vertex_transformation.get_vertex_shader())
+    {
+        ctx.vertex_transformation.get_vertex_shader()->set_bindings(&ctx.draw_bindings);
+    }
+    if (ctx.rasterizer.get_pixel_shader())
+    {
+        ctx.rasterizer.get_pixel_shader()->set_bindings(&ctx.draw_bindings);
+    }
+    if (!ctx.visibility_buffer.is_active())
+    {
+        return result_ok;
+    }
+    if (primitive_assembler_t::vertices_per_primitive(ctx.bound_primitive_topology) != 3)
+    {
+        return result_failed;
+    }
+    uint32_t const_buffer_sizes[SWRAST_MAX_CONST_BUFFERS];
+    for (uint32_t slot = 0; slot < SWRAST_MAX_CONST_BUFFERS; ++slot)
+    {
+        const resource_t resource = ctx.const_buffers[slot];
+        const_buffer_sizes[slot] = resource ? (uint32_t)resource_size_bytes(*(const resource_desc_t*)(resource - sizeof(resource_desc_t))) : 0;
+    }
+    const interpolator_layout_t& interpolator = ctx.rasterizer.get_interpolator();
+    if (!ctx.visibility_buffer.begin_draw(ctx.rasterizer.get_pixel_shader(), ctx.draw_bindings, const_buffer_sizes, interpolator))
+    {
+        // Out of draw ids.
+        resolve_visibility(ctx);
+        ctx.visibility_buffer.begin_draw(ctx.rasterizer.get_pixel_shader(), ctx.draw_bindings, const_buffer_sizes, interpolator);
+    }
     return result_ok;
 }
 
 
+// Draws are split into batches of SWRAST_DRAW_BATCH_SIZE indices, so memory used by a draw is bounded by the 
+// batch size, no matter how large the draw is. Batches go through the geometry pipeline, which overlaps 
+// shading of the next batch with rasterization of the current one.
+static error_t draw_batches(render_context_t& ctx, uint32_t num_indices, uint32_t instance_count, uint32_t first_instance)
+{
+    geometry_draw_t draw = { };
+    draw.num_indices = num_indices;
+    draw.instance_count = instance_count;
+    draw.first_instance = first_instance;
+    draw.topology = ctx.bound_primitive_topology;
+    return ctx.geometry_pipeline.draw(draw, ctx.rasterizer, ctx.winding_order);
+}
+
+
+error_t draw_instanced(uint32_t num_vertices, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_draw_instanced(queued_commands(ctx), num_vertices, instance_count, first_vertex, first_instance));
+    }
+    ctx.vertex_transformation.begin_draw(false, first_vertex, 0);
+    if (bind_draw_resources(ctx) != result_ok)
+    {
+        return result_failed;
+    }
+    return draw_batches(ctx, num_vertices, instance_count, first_instance);
+}
+
+
 error_t draw_indexed_instanced(uint32_t num_indices, uint32_t num_instances, uint32_t first_index, uint32_t vertex_offset, uint32_t first_instance)
 {
-    vertices_t vertex_pool = assembler.get_available_vertex_pool(UINT16_MAX * num_instances, 
-        vertex_transformation.get_vertex_shader()->get_out_vertex_stride());
-    // We probably won't use all vertices since we are relying on vertex indices.
-    // But theoretically we will have enough just in case.
-    vertex_pool.num_vertices = num_indices;
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_draw_indexed_instanced(queued_commands(ctx), num_indices, num_instances, first_index, vertex_offset, first_instance));
+    }
+    // Only unique vertices of a batch are fetched and shaded, repeated indices reuse the cached vertex.
+    ctx.vertex_transformation.begin_draw(true, first_index, vertex_offset);
+    if (bind_draw_resources(ctx) != result_ok)
+    {
+        return result_failed;
+    }
+    return draw_batches(ctx, num_indices, num_instances, first_instance);
+}
 
-    // transform our vertices with the provided vertex shader.
-    vertex_transformation.transform_indexed(&vertex_pool, first_index, vertex_offset, num_indices);
 
-    // The clipper clips any vertices that won't be in the clip/view volume.
-    // If all vertices of the triangle are clipped, then that triangle is considered culled.
-    clipper.clip_cull(&vertex_pool);
-    
-    // Primitive generator creates our triangles.
-    // In this case, we can just reinterpret our vertices as triangles.
-    uint32_t num_triangles = vertex_pool.num_vertices / 3;
+error_t draw_indexed_indirect(resource_t args, uint32_t count, uint32_t stride)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_draw_indexed_indirect(queued_commands(ctx), args, count, stride));
+    }
+    if (!args || stride < sizeof(draw_indexed_indirect_args_t))
+    {
+        return result_failed;
+    }
+    if (!count)
+    {
+        return result_ok;
+    }
+    // Every record has to be within the buffer.
+    const resource_desc_t* desc = (const resource_desc_t*)(args - sizeof(resource_desc_t));
+    if (desc->type != resource_type_buffer || 
+        (uint64_t)(count - 1) * stride + sizeof(draw_indexed_indirect_args_t) > resource_size_bytes(*desc))
+    {
+        return result_failed;
+    }
 
-    // finally rasterize onto framebuffer. Triangles are left in clip space,
-    // so the rasterizer will convert them into ndc, for which they will then 
-    // be projected into screen space.
-    rasterizer.raster(num_triangles, vertex_pool, winding_order);
+    if (bind_draw_resources(ctx) != result_ok)
+    {
+        return result_failed;
+    }
+    for (uint32_t draw_i = 0; draw_i < count; ++draw_i)
+    {
+        // Records only need to be 4 byte aligned, within the buffer.
+        draw_indexed_indirect_args_t draw_args;
+        memcpy(&draw_args, (const void*)(args + (uint64_t)draw_i * stride), sizeof(draw_args));
+        if (!draw_args.num_indices || !draw_args.num_instances)
+        {
+            continue;
+        }
+        ctx.vertex_transformation.begin_draw(true, draw_args.first_index, draw_args.vertex_offset);
+        const error_t result = draw_batches(ctx, draw_args.num_indices, draw_args.num_instances, draw_args.first_instance);
+        if (result != result_ok)
+        {
+            return result;
+        }
+    }
     return result_ok;
 }
 
 
+error_t dispatch(uint32_t groups_x, uint32_t groups_y, uint32_t groups_z)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_dispatch(queued_commands(ctx), groups_x, groups_y, groups_z));
+    }
+    if (!ctx.compute_shader)
+    {
+        return result_failed;
+    }
+    resolve_visibility(ctx);
+    resolve_const_buffers(ctx);
+    ctx.compute_shader->set_bindings(&ctx.draw_bindings);
+    return ctx.compute_dispatcher.dispatch(*ctx.compute_shader, groups_x, groups_y, groups_z);
+}
+
+
+error_t draw_point_splats(const point_splat_desc_t& desc)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_draw_point_splats(queued_commands(ctx), desc));
+    }
+    resolve_visibility(ctx);
+    return ctx.point_splatter.splat(desc, ctx.rasterizer);
+}
+
+
 error_t bind_vertex_shader(vertex_shader_t* shader)
 {
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        ctx.queued_vertex_shader = shader;
+        return cmd_bind_vertex_shader(queued_commands(ctx), shader);
+    }
     // Find the vertex shader, and bind it to vertex transformer.
-    return vertex_transformation.bind_vertex_shader(shader);
+    return ctx.vertex_transformation.bind_vertex_shader(shader);
 }
 
 
 error_t bind_pixel_shader(pixel_shader_t* shader)
 {
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        ctx.queued_pixel_shader = shader;
+        return cmd_bind_pixel_shader(queued_commands(ctx), shader);
+    }
     // Find the pixel shader, and bind it to the rasterizer.
-    return rasterizer.bind_pixel_shader(shader);
+    return ctx.rasterizer.bind_pixel_shader(shader);
+}
+
+
+error_t rebind_pixel_shader(pixel_shader_t* shader)
+{
+    return current_context().rasterizer.rebind_pixel_shader(shader);
+}
+
+
+error_t bind_compute_shader(compute_shader_t* shader)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_compute_shader(queued_commands(ctx), shader);
+    }
+    ctx.compute_shader = shader;
+    return result_ok;
+}
+
+
+error_t bind_shader_resource(uint32_t slot, resource_t resource)
+{
+    render_context_t& ctx = current_context();
+    if (slot >= SWRAST_MAX_SHADER_RESOURCES)
+    {
+        return result_failed;
+    }
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_shader_resource(queued_commands(ctx), slot, resource);
+    }
+    ctx.draw_bindings.shader_resources[slot] = resource;
+    return result_ok;
+}
+
+
+error_t bind_unordered_access(uint32_t slot, resource_t resource)
+{
+    render_context_t& ctx = current_context();
+    if (slot >= SWRAST_MAX_UNORDERED_ACCESS_VIEWS)
+    {
+        return result_failed;
+    }
+    if (resource)
+    {
+        const resource_desc_t* desc = (const resource_desc_t*)(resource - sizeof(resource_desc_t));
+        if (!(desc->usage & usage_unordered_access) || !is_storable_format(desc->format))
+        {
+            return result_failed;
+        }
+    }
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_unordered_access(queued_commands(ctx), slot, resource);
+    }
+    ctx.draw_bindings.unordered_access[slot] = resource;
+    return result_ok;
+}
+
+
+error_t bind_const_buffer(uint32_t slot, resource_t resource)
+{
+    render_context_t& ctx = current_context();
+    if (slot >= SWRAST_MAX_CONST_BUFFERS)
+    {
+        return result_failed;
+    }
+    if (record_to_queue(ctx))
+    {
+        ctx.queued_const_buffers[slot] = resource;
+        return cmd_bind_const_buffer(queued_commands(ctx), slot, resource);
+    }
+    // Draws read whatever version is current when they run.
+    return bind_const_buffer_version(slot, resource, 0);
+}
+
+
+error_t bind_const_buffer_version(uint32_t slot, resource_t resource, uintptr_t version)
+{
+    render_context_t& ctx = current_context();
+    ctx.const_buffers[slot] = resource;
+    ctx.const_buffer_versions[slot] = version;
+    return result_ok;
 }
 
 
 error_t set_primitive_topology(primitive_topology_t primitive_topology)
 {
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_primitive_topology(queued_commands(ctx), primitive_topology);
+    }
     switch (primitive_topology)
     {
+        case primitive_topology_trianglelist:
+        case primitive_topology_trianglestrip:
+        case primitive_topology_trianglefan:
+        case primitive_topology_points:
+        case primitive_topology_lines:
+        case primitive_topology_linestrip:
+            break;
         default:
             return result_failed;
     }
-    bound_primitive_topology = primitive_topology;
+    ctx.bound_primitive_topology = primitive_topology;
     return result_ok;
 }
 
 
 error_t set_depth_compare(compare_op_t compare_op)
 {
-    rasterizer.set_depth_compare_op(compare_op);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_depth_compare(queued_commands(ctx), compare_op);
+    }
+    ctx.rasterizer.set_depth_compare_op(compare_op);
     return result_ok;
 }
 
 
+// Zero a surface, with every band of rows written by the worker owning it. Pages are placed on the NUMA node 
+// of the thread that touches them first, so each band ends up local to the worker rasterizing it.
+static void first_touch_surface(render_context_t& ctx, uintptr_t surface, const resource_desc_t& desc)
+{
+    const size_t row_pitch = desc.width * format_size_bytes(desc.format);
+    const size_t slice_pitch = desc.height * row_pitch;
+    const uint32_t num_slices = desc.depth_or_array_size * desc.mip_count;
+    std::atomic<uint32_t> counter(ctx.job_system.get_num_workers());
+    const auto touch_band = [&] (uint32_t worker, uint32_t)
+    {
+        // Rows owned by this worker are contiguous.
+        uint32_t first_row = 0;
+        while (first_row < desc.height && ctx.job_system.get_row_owner(first_row, desc.height) < worker) ++first_row;
+        uint32_t last_row = first_row;
+        while (last_row < desc.height && ctx.job_system.get_row_owner(last_row, desc.height) == worker) ++last_row;
+        for (uint32_t slice = 0; slice < num_slices; ++slice)
+        {
+            memset((void*)(surface + slice * slice_pitch + first_row * row_pitch), 0, (last_row - first_row) * row_pitch);
+        }
+    };
+    for (uint32_t worker = 1; worker <= ctx.job_system.get_num_workers(); ++worker)
+    {
+        job_t job = { };
+        job.function = [] (void* data, uint32_t begin, uint32_t end) { (*(decltype(touch_band)*)data)(begin, end); };
+        job.data = (void*)&touch_band;
+        job.begin = worker;
+        job.counter = &counter;
+        job.flags = job_flag_pinned;
+        ctx.job_system.submit(job, worker);
+    }
+    ctx.job_system.wait(counter);
+}
+
+
 resource_t allocate_resource(const resource_desc_t& desc)
 {
+    render_context_t& ctx = current_context();
     resource_t res = 0;
-    size_t size_bytes = desc.width * desc.height * desc.depth_or_array_size * desc.mip_count * format_size_bytes(desc.format);
+    size_t size_bytes = (size_t)resource_size_bytes(desc);
     // Allocate the size of the resource descriptor too.
     size_bytes += sizeof(resource_desc_t);
-    res = (resource_t)resource_allocator->allocate(size_bytes, 1);
-    // the memory surface should be initialized to all zeroes.
-    memset((void*)res, 0, size_bytes);
+    // Constant buffers also track their current version, in front of the descriptor.
+    const size_t header_size_bytes = (desc.usage & usage_constant_buffer) ? sizeof(const_buffer_header_t) : 0;
+    res = (resource_t)ctx.resource_allocator->allocate(header_size_bytes + size_bytes, 1) + header_size_bytes;
+    // the memory surface should be initialized to all zeroes. Render targets and depth buffers, split between 
+    // workers, are zeroed by their owners instead.
+    const bool owned_rows = ctx.job_system.has_row_owners() && (desc.usage & (usage_render_target | usage_depth_stencil));
+    if (owned_rows)
+    {
+        // The queue thread is the only external thread allowed to run jobs, while it has work.
+        finish_queue(ctx);
+        first_touch_surface(ctx, res + sizeof(resource_desc_t), desc);
+    }
+    else
+    {
+        memset((void*)res, 0, size_bytes);
+    }
     // Store description of the resource. The pass along the resource handle base.
     *((resource_desc_t*)res) = desc;
     res += sizeof(resource_desc_t);
+    if (header_size_bytes)
+    {
+        get_const_buffer_header(res)->version.store(res, std::memory_order_relaxed);
+    }
     return res;
 }
 
 
 error_t release_resource(resource_t resource)
 {
+    render_context_t& ctx = current_context();
+    // Queued work may still use the resource.
+    finish_queue(ctx);
+    const resource_desc_t* desc = (const resource_desc_t*)(resource - sizeof(resource_desc_t));
+    if (desc->usage & usage_constant_buffer)
+    {
+        const_buffer_header_t* header = get_const_buffer_header(resource);
+        const_block_t* block = get_version_block(resource, header->version.load(std::memory_order_acquire));
+        if (block)
+        {
+            block->references.fetch_sub(1, std::memory_order_release);
+        }
+        ctx.resource_allocator->free((void*)header);
+        return result_ok;
+    }
     resource -= sizeof(resource_desc_t);
-    resource_allocator->free((void*)resource);
+    ctx.resource_allocator->free((void*)resource);
     return result_ok;
 }
 
 
 error_t bind_render_targets(uint32_t num_rtvs, resource_t* rtvs, resource_t dsv)
 {
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_render_targets(queued_commands(ctx), num_rtvs, rtvs, dsv);
+    }
+    resolve_visibility(ctx);
     framebuffer_t framebuffer = { };
     for (uint32_t i = 0; i < num_rtvs; ++i)
     {
@@ -185,81 +691,371 @@ error_t bind_render_targets(uint32_t num_rtvs, resource_t* rtvs, resource_t dsv)
     }
     framebuffer.num_render_targets = num_rtvs;
     framebuffer.bound_depth_stencil = dsv;
-    rasterizer.bind_frame_buffer(framebuffer);
+    ctx.rasterizer.bind_frame_buffer(framebuffer);
+    return result_ok;
+}
+
+
+error_t bind_depth_stencil(resource_t ds)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_depth_stencil(queued_commands(ctx), ds);
+    }
+    resolve_visibility(ctx);
+    ctx.rasterizer.get_frame_buffer().bound_depth_stencil = ds;
     return result_ok;
 }
 
 
 error_t set_viewports(uint32_t count, viewport_t* viewports)
 {
-    return rasterizer.set_viewports(count, viewports);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_viewports(queued_commands(ctx), count, viewports);
+    }
+    return ctx.rasterizer.set_viewports(count, viewports);
+}
+
+
+error_t set_view_instancing(uint32_t view_count, view_instance_location_t* locations)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_view_instancing(queued_commands(ctx), view_count, locations);
+    }
+    error_t result = ctx.rasterizer.set_view_instancing(view_count, locations);
+    if (result == result_ok)
+    {
+        ctx.vertex_transformation.set_view_count(view_count);
+    }
+    return result;
 }
 
 
 error_t bind_vertex_buffers(uint32_t num_vbs, resource_t* vbs)
 {
-    return vertex_transformation.bind_vertex_buffers(num_vbs, vbs);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_vertex_buffers(queued_commands(ctx), num_vbs, vbs);
+    }
+    return ctx.vertex_transformation.bind_vertex_buffers(num_vbs, vbs);
 }
 
 
 error_t set_front_face(front_face_t front_face)
 {
-    winding_order = front_face;
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_front_face(queued_commands(ctx), front_face);
+    }
+    ctx.winding_order = front_face;
+    return result_ok;
+}
+
+
+error_t set_line_width(float width)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_line_width(queued_commands(ctx), width);
+    }
+    ctx.rasterizer.set_line_width(width);
+    return result_ok;
+}
+
+
+error_t set_point_size(float size)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_point_size(queued_commands(ctx), size);
+    }
+    ctx.rasterizer.set_point_size(size);
     return result_ok;
 }
 
 
 error_t enable_depth(bool enable)
 {
-    rasterizer.enable_depth(true);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_enable_depth(queued_commands(ctx), enable);
+    }
+    ctx.rasterizer.enable_depth(enable);
     return result_ok;
 }
 
 
 error_t enable_depth_write(bool enable)
 {
-    rasterizer.enable_write_depth(enable);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_enable_depth_write(queued_commands(ctx), enable);
+    }
+    ctx.rasterizer.enable_write_depth(enable);
     return result_ok;
 }
 
 
 error_t clear_render_target(uint32_t index, const rect_t& rect, float* rgba)
 {
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_clear_render_target(queued_commands(ctx), index, rect, rgba));
+    }
+    resolve_visibility(ctx);
     float4_t clear_color = { rgba[0], rgba[1], rgba[2], rgba[3] };
-    return rasterizer.clear_render_target(index, rect, clear_color);
+    return ctx.rasterizer.clear_render_target(index, rect, clear_color);
 }
 
 
 error_t clear_depth_stencil(float depth, const rect_t& rect)
 {
-    return rasterizer.clear_depth_stencil(rect, depth);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_clear_depth_stencil(queued_commands(ctx), depth, rect));
+    }
+    resolve_visibility(ctx);
+    return ctx.rasterizer.clear_depth_stencil(rect, depth);
+}
+
+
+error_t begin_visibility_pass()
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_begin_visibility_pass(queued_commands(ctx));
+    }
+    if (ctx.visibility_buffer.is_active())
+    {
+        return result_failed;
+    }
+    ctx.visibility_buffer.set_active(true);
+    ctx.rasterizer.set_visibility_buffer(&ctx.visibility_buffer);
+    return result_ok;
 }
 
 
-input_layout_t create_input_layout(uint32_t num_elements, input_element_desc* descs)
+error_t end_visibility_pass()
 {
-    input_layout* layout = assembler.create_input_layout(num_elements, descs);
-    return (input_layout_t)layout;
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return kick_queue(ctx, cmd_end_visibility_pass(queued_commands(ctx)));
+    }
+    if (!ctx.visibility_buffer.is_active())
+    {
+        return result_failed;
+    }
+    resolve_visibility(ctx);
+    ctx.visibility_buffer.set_active(false);
+    ctx.rasterizer.set_visibility_buffer(nullptr);
+    return result_ok;
 }
 
 
 error_t set_input_layout(input_layout_t layout)
 {
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_input_layout(queued_commands(ctx), layout);
+    }
     input_layout* input = (input_layout*)layout;
-    vertex_transformation.bind_input_layout(input);
+    ctx.vertex_transformation.bind_input_layout(input);
+    return result_ok;
+}
+
+
+error_t bind_pipeline_state(pipeline_state_t pipeline_state)
+{
+    render_context_t& ctx = current_context();
+    const pipeline_state_object_t* pso = (const pipeline_state_object_t*)pipeline_state;
+    if (!pso)
+    {
+        return result_failed;
+    }
+    if (record_to_queue(ctx))
+    {
+        ctx.queued_vertex_shader = pso->desc.vertex_shader;
+        ctx.queued_pixel_shader = pso->desc.pixel_shader;
+        return cmd_bind_pipeline_state(queued_commands(ctx), pipeline_state);
+    }
+    // Validated, and derived, when the pipeline state was created.
+    ctx.vertex_transformation.bind_vertex_shader(pso->desc.vertex_shader);
+    ctx.vertex_transformation.bind_input_layout(pso->layout);
+    ctx.vertex_transformation.enable_primitive_restart(pso->desc.primitive_restart_enable);
+    ctx.bound_primitive_topology = pso->desc.primitive_topology;
+    ctx.winding_order = pso->desc.front_face;
+    ctx.rasterizer.bind_pipeline_state(pso->raster_state);
     return result_ok;
 }
 
 
 error_t set_cull_mode(cull_mode_t cull_mode)
 {
-    rasterizer.set_cull_mode(cull_mode);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_set_cull_mode(queued_commands(ctx), cull_mode);
+    }
+    ctx.rasterizer.set_cull_mode(cull_mode);
     return result_ok;
 }
 
 
-error_t bind_index_buffer(resource_t ib)
+error_t bind_index_buffer(resource_t ib, format_t format)
 {
-    return vertex_transformation.bind_index_buffer(ib);
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_bind_index_buffer(queued_commands(ctx), ib, format);
+    }
+    return ctx.vertex_transformation.bind_index_buffer(ib, format);
+}
+
+
+error_t enable_primitive_restart(bool enable)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        return cmd_enable_primitive_restart(queued_commands(ctx), enable);
+    }
+    ctx.vertex_transformation.enable_primitive_restart(enable);
+    return result_ok;
+}
+
+
+error_t submit(uint32_t num_command_lists, command_list_t* command_lists)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        // Copied, so the command lists can be reset, or recorded again, right away.
+        command_buffer_t* pending = (command_buffer_t*)queued_commands(ctx);
+        for (uint32_t i = 0; i < num_command_lists; ++i)
+        {
+            pending->append(*(command_buffer_t*)command_lists[i]);
+        }
+        ctx.queued_vertex_shader = pending->get_vertex_shader();
+        ctx.queued_pixel_shader = pending->get_pixel_shader();
+        memcpy(ctx.queued_const_buffers, pending->get_const_buffers(), sizeof(ctx.queued_const_buffers));
+        return kick_queue(ctx, result_ok);
+    }
+    for (uint32_t i = 0; i < num_command_lists; ++i)
+    {
+        error_t result = ((command_buffer_t*)command_lists[i])->execute();
+        if (result != result_ok)
+        {
+            return result;
+        }
+    }
+    return result_ok;
+}
+
+
+error_t flush()
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        flush_pending_commands(ctx);
+    }
+    return result_ok;
+}
+
+
+fence_t create_fence()
+{
+    return (fence_t)new fence_object_t();
+}
+
+
+error_t destroy_fence(fence_t fence)
+{
+    delete (fence_object_t*)fence;
+    return result_ok;
+}
+
+
+error_t signal_fence(fence_t fence, uint64_t value)
+{
+    render_context_t& ctx = current_context();
+    if (record_to_queue(ctx))
+    {
+        cmd_signal_fence(queued_commands(ctx), fence, value);
+        flush_pending_commands(ctx);
+        return result_ok;
+    }
+    ((fence_object_t*)fence)->signal(value);
+    return result_ok;
+}
+
+
+error_t wait_fence(fence_t fence, uint64_t value)
+{
+    // The signal may still be among the pending commands.
+    flush();
+    ((fence_object_t*)fence)->wait(value);
+    return result_ok;
+}
+
+
+uint64_t query_fence(fence_t fence)
+{
+    return ((fence_object_t*)fence)->query();
+}
+
+
+error_t map_resource(void** ptr, resource_t resource)
+{
+    render_context_t& ctx = current_context();
+    // Mapping is a completion point, every queued draw and clear is done when it returns.
+    finish_queue(ctx);
+    const resource_desc_t* desc = (const resource_desc_t*)(resource - sizeof(resource_desc_t));
+    *ptr = (desc->usage & usage_constant_buffer) ? (void*)get_const_buffer_header(resource)->version.load(std::memory_order_acquire) : (void*)resource;
+    return result_ok;
+}
+
+
+error_t map_resource_discard(void** ptr, resource_t resource)
+{
+    render_context_t& ctx = current_context();
+    const resource_desc_t* desc = (const resource_desc_t*)(resource - sizeof(resource_desc_t));
+    if (!(desc->usage & usage_constant_buffer))
+    {
+        return result_failed;
+    }
+    // Not a completion point. Draws recorded so far keep reading the previous version.
+    const uint32_t size_bytes = (uint32_t)resource_size_bytes(*desc);
+    const uintptr_t version = ctx.constant_ring.allocate(size_bytes);
+    const uintptr_t previous = get_const_buffer_header(resource)->version.exchange(version, std::memory_order_acq_rel);
+    const_block_t* previous_block = get_version_block(resource, previous);
+    if (previous_block)
+    {
+        previous_block->references.fetch_sub(1, std::memory_order_release);
+    }
+    *ptr = (void*)version;
+    return result_ok;
+}
+
+
+error_t unmap_resource(resource_t)
+{
+    return result_ok;
 }
-} // 
\ No newline at end of file
+} //
\ No newline at end of file
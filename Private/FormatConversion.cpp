@@ -0,0 +1,328 @@
+//
+#include "FormatConversion.hpp"
+#include "Math.hpp"
+#include <cstring>
+
+namespace swrast {
+
+
+// Convert 4 half floats, in the lower 16 bits of each lane, to floats. Denormals are handled by rebiasing
+// the exponent through a float multiply, and inf/nan get their exponent forced to all ones.
+static __m128 half4_to_float4(__m128i halfs)
+{
+    const __m128i mask_no_sign = _mm_set1_epi32(0x7FFF);
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+    const __m128i was_inf_nan = _mm_set1_epi32(0x7BFF);
+    const __m128 exp_inf_nan = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+
+    const __m128i exp_mantissa = _mm_and_si128(mask_no_sign, halfs);
+    const __m128i just_sign = _mm_xor_si128(halfs, exp_mantissa);
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exp_mantissa, 13)), magic);
+    const __m128i is_inf_nan = _mm_cmpgt_epi32(exp_mantissa, was_inf_nan);
+    const __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(just_sign, 16));
+    const __m128 inf_nan = _mm_and_ps(_mm_castsi128_ps(is_inf_nan), exp_inf_nan);
+    return _mm_or_ps(scaled, _mm_or_ps(sign, inf_nan));
+}
+
+
+// Load 2 or 4 16 bit values into the lower 16 bits of each lane. Upper lanes are 0 for 2 values.
+static __m128i load_unsigned16(const void* src, uint32_t count)
+{
+    int32_t low = 0;
+    memcpy(&low, src, sizeof(low));
+    const __m128i packed = (count == 4) ? _mm_loadl_epi64((const __m128i*)src) : _mm_cvtsi32_si128(low);
+    return _mm_unpacklo_epi16(packed, _mm_setzero_si128());
+}
+
+
+// Same as load_unsigned16, but sign extends each value.
+static __m128i load_signed16(const void* src, uint32_t count)
+{
+    int32_t low = 0;
+    memcpy(&low, src, sizeof(low));
+    const __m128i packed = (count == 4) ? _mm_loadl_epi64((const __m128i*)src) : _mm_cvtsi32_si128(low);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(_mm_setzero_si128(), packed), 16);
+}
+
+
+// Snorm maps both -32768 and -32767 to -1.
+static __m128 snorm16_to_float4(__m128i values)
+{
+    return _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(values), _mm_set1_ps(1.0f / 32767.0f)), _mm_set1_ps(-1.0f));
+}
+
+
+// Store the first count lanes.
+static void store_float(float* dst, __m128 values, uint32_t count)
+{
+    if (count == 4)
+    {
+        _mm_storeu_ps(dst, values);
+    }
+    else
+    {
+        _mm_storel_pi((__m64*)dst, values);
+    }
+}
+
+
+// Unsigned small float, with a 5 bit exponent, as used by r11g11b10.
+static float unsigned_small_float_to_float(uint32_t bits, uint32_t mantissa_bits)
+{
+    const uint32_t exponent = bits >> mantissa_bits;
+    const uint32_t mantissa = bits & ((1u << mantissa_bits) - 1);
+    const float fraction = (float)mantissa / (float)(1u << mantissa_bits);
+    if (exponent == 0)
+    {
+        return std::ldexp(fraction, -14);
+    }
+    if (exponent == 31)
+    {
+        return mantissa ? NAN : INFINITY;
+    }
+    return std::ldexp(1.0f + fraction, (int)exponent - 15);
+}
+
+
+uint32_t format_decoded_size_bytes(format_t format)
+{
+    switch (format)
+    {
+        case format_r8_unorm:
+        case format_r32_float:
+        case format_r16_uint:
+        case format_r32_uint:
+        case format_r16_float:
+            return 4;
+
+        case format_r16g16_float:
+        case format_r32g32_float:
+        case format_r16g16_snorm:
+        case format_r16g16_unorm:
+            return 8;
+
+        case format_r11g11b10_float:
+        case format_r32g32b32_float:
+        case format_r16g16_snorm_octahedral:
+            return 12;
+
+        case format_r8g8b8a8_unorm:
+        case format_r16g16b16a16_float:
+        case format_r32g32b32a32_float:
+        case format_r16g16b16a16_snorm:
+        case format_r16g16b16a16_unorm:
+        case format_r10g10b10a2_unorm:
+            return 16;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+
+void decode_element(format_t format, const void* src, void* dst)
+{
+    float* out = (float*)dst;
+    switch (format)
+    {
+        case format_r32_float:
+        case format_r32g32_float:
+        case format_r32g32b32_float:
+        case format_r32g32b32a32_float:
+        case format_r32_uint:
+        {
+            // Already 32 bits per component.
+            memcpy(dst, src, format_size_bytes(format));
+            break;
+        }
+        case format_r16_uint:
+        {
+            uint16_t value;
+            memcpy(&value, src, sizeof(value));
+            *(uint32_t*)dst = value;
+            break;
+        }
+        case format_r8_unorm:
+        {
+            out[0] = (float)(*(const uint8_t*)src) * (1.0f / 255.0f);
+            break;
+        }
+        case format_r8g8b8a8_unorm:
+        {
+            int32_t packed;
+            memcpy(&packed, src, sizeof(packed));
+            const __m128i zero = _mm_setzero_si128();
+            __m128i bytes = _mm_cvtsi32_si128(packed);
+            bytes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+            _mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(bytes), _mm_set1_ps(1.0f / 255.0f)));
+            break;
+        }
+        case format_r16_float:
+        {
+            uint16_t value;
+            memcpy(&value, src, sizeof(value));
+            _mm_store_ss(out, half4_to_float4(_mm_cvtsi32_si128(value)));
+            break;
+        }
+        case format_r16g16_float:
+        case format_r16g16b16a16_float:
+        {
+            const uint32_t count = (format == format_r16g16_float) ? 2 : 4;
+            store_float(out, half4_to_float4(load_unsigned16(src, count)), count);
+            break;
+        }
+        case format_r16g16_snorm:
+        case format_r16g16b16a16_snorm:
+        {
+            const uint32_t count = (format == format_r16g16_snorm) ? 2 : 4;
+            store_float(out, snorm16_to_float4(load_signed16(src, count)), count);
+            break;
+        }
+        case format_r16g16_unorm:
+        case format_r16g16b16a16_unorm:
+        {
+            const uint32_t count = (format == format_r16g16_unorm) ? 2 : 4;
+            const __m128 values = _mm_cvtepi32_ps(load_unsigned16(src, count));
+            store_float(out, _mm_mul_ps(values, _mm_set1_ps(1.0f / 65535.0f)), count);
+            break;
+        }
+        case format_r10g10b10a2_unorm:
+        {
+            int32_t packed;
+            memcpy(&packed, src, sizeof(packed));
+            // Mask each component in place, and fold the shift into the scale. Alpha is pre shifted, 
+            // to keep the sign bit clear for the signed int conversion.
+            const __m128i lanes = _mm_set_epi32((int32_t)((uint32_t)packed >> 2), packed, packed, packed);
+            const __m128i masks = _mm_set_epi32(0x3 << 28, 0x3FF << 20, 0x3FF << 10, 0x3FF);
+            const __m128 scales = _mm_set_ps(1.0f / (3.0f * (1 << 28)), 1.0f / (1023.0f * (1 << 20)), 1.0f / (1023.0f * (1 << 10)), 1.0f / 1023.0f);
+            _mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(lanes, masks)), scales));
+            break;
+        }
+        case format_r16g16_snorm_octahedral:
+        {
+            alignas(16) float oct[4];
+            _mm_store_ps(oct, snorm16_to_float4(load_signed16(src, 2)));
+            // Unfold the lower hemisphere, and normalize.
+            float3_t n(oct[0], oct[1], 1.0f - std::fabs(oct[0]) - std::fabs(oct[1]));
+            const float t = maximum<float>(-n.z, 0.0f);
+            n.x += (n.x >= 0.0f) ? -t : t;
+            n.y += (n.y >= 0.0f) ? -t : t;
+            const float inv_length = 1.0f / std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+            out[0] = n.x * inv_length;
+            out[1] = n.y * inv_length;
+            out[2] = n.z * inv_length;
+            break;
+        }
+        case format_r11g11b10_float:
+        {
+            uint32_t packed;
+            memcpy(&packed, src, sizeof(packed));
+            out[0] = unsigned_small_float_to_float(packed & 0x7FF, 6);
+            out[1] = unsigned_small_float_to_float((packed >> 11) & 0x7FF, 6);
+            out[2] = unsigned_small_float_to_float(packed >> 22, 5);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+
+bool is_storable_format(format_t format)
+{
+    switch (format)
+    {
+        case format_r8_unorm:
+        case format_r8g8b8a8_unorm:
+        case format_r16g16_unorm:
+        case format_r16g16b16a16_unorm:
+        case format_r10g10b10a2_unorm:
+        case format_r32_float:
+        case format_r32g32_float:
+        case format_r32g32b32_float:
+        case format_r32g32b32a32_float:
+        case format_r16_uint:
+        case format_r32_uint:
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+
+// Round to nearest, after clamping to [0, 1].
+static uint32_t float_to_unorm(float value, uint32_t max_value)
+{
+    return (uint32_t)(clamp(value, 0.0f, 1.0f) * (float)max_value + 0.5f);
+}
+
+
+static uint32_t float_to_uint(float value, uint32_t max_value)
+{
+    return (value >= (float)max_value) ? max_value : (value > 0.0f ? (uint32_t)value : 0u);
+}
+
+
+void encode_element(format_t format, const float4_t& value, void* dst)
+{
+    switch (format)
+    {
+        case format_r8_unorm:
+        {
+            const uint8_t packed = (uint8_t)float_to_unorm(value.x, 0xFF);
+            memcpy(dst, &packed, sizeof(packed));
+            break;
+        }
+        case format_r8g8b8a8_unorm:
+        {
+            const uint32_t packed = float_to_unorm(value.x, 0xFF) | (float_to_unorm(value.y, 0xFF) << 8) | 
+                (float_to_unorm(value.z, 0xFF) << 16) | (float_to_unorm(value.w, 0xFF) << 24);
+            memcpy(dst, &packed, sizeof(packed));
+            break;
+        }
+        case format_r16g16_unorm:
+        case format_r16g16b16a16_unorm:
+        {
+            const uint16_t packed[4] = 
+            { 
+                (uint16_t)float_to_unorm(value.x, 0xFFFF), (uint16_t)float_to_unorm(value.y, 0xFFFF), 
+                (uint16_t)float_to_unorm(value.z, 0xFFFF), (uint16_t)float_to_unorm(value.w, 0xFFFF) 
+            };
+            memcpy(dst, packed, format_size_bytes(format));
+            break;
+        }
+        case format_r10g10b10a2_unorm:
+        {
+            const uint32_t packed = float_to_unorm(value.x, 0x3FF) | (float_to_unorm(value.y, 0x3FF) << 10) | 
+                (float_to_unorm(value.z, 0x3FF) << 20) | (float_to_unorm(value.w, 0x3) << 30);
+            memcpy(dst, &packed, sizeof(packed));
+            break;
+        }
+        case format_r32_float:
+        case format_r32g32_float:
+        case format_r32g32b32_float:
+        case format_r32g32b32a32_float:
+        {
+            const float components[4] = { value.x, value.y, value.z, value.w };
+            memcpy(dst, components, format_size_bytes(format));
+            break;
+        }
+        case format_r16_uint:
+        {
+            const uint16_t packed = (uint16_t)float_to_uint(value.x, 0xFFFF);
+            memcpy(dst, &packed, sizeof(packed));
+            break;
+        }
+        case format_r32_uint:
+        {
+            const uint32_t packed = float_to_uint(value.x, 0xFFFFFFFF);
+            memcpy(dst, &packed, sizeof(packed));
+            break;
+        }
+        default:
+            break;
+    }
+}
+} // swrast
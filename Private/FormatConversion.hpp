@@ -0,0 +1,22 @@
+//
+#pragma once
+
+#include "Context.hpp"
+
+namespace swrast {
+
+
+// Size of an element of the given format, once decoded for the vertex shader. Every component is decoded 
+// into 32 bits, float for float/norm formats, and uint32 for uint formats.
+uint32_t format_decoded_size_bytes(format_t format);
+
+// Decode a single element into 32 bit components. src does not need to be aligned.
+void decode_element(format_t format, const void* src, void* dst);
+
+// Formats encode_element() supports, the formats unordered access views can be bound with.
+bool is_storable_format(format_t format);
+
+// Encode a single element from float components, the opposite of decode_element(). Norm formats are clamped 
+// to their range, uint formats are converted from the float value, and clamped. Extra components are dropped.
+void encode_element(format_t format, const float4_t& value, void* dst);
+} // swrast
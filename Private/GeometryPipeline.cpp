@@ -0,0 +1,170 @@
+//
+#include "GeometryPipeline.hpp"
+
+#include <cstring>
+
+namespace swrast {
+
+
+error_t geometry_pipeline_t::initialize(vertex_transformation_t* transformation, clipper_t* clipper, primitive_assembler_t* primitive_assembler, job_system_t* job_system)
+{
+    m_transformation = transformation;
+    m_clipper = clipper;
+    m_primitive_assembler = primitive_assembler;
+    m_job_system = job_system;
+    for (uint32_t i = 0; i < SWRAST_GEOMETRY_PIPELINE_DEPTH; ++i)
+    {
+        m_free_batches.push(i);
+    }
+    return result_ok;
+}
+
+
+error_t geometry_pipeline_t::release()
+{
+    uint32_t batch_index;
+    while (m_free_batches.pop(batch_index)) { }
+    for (uint32_t i = 0; i < SWRAST_GEOMETRY_PIPELINE_DEPTH; ++i)
+    {
+        m_batches[i].vertex_memory.release();
+        m_batches[i].index_memory.release();
+    }
+    return result_ok;
+}
+
+
+void geometry_pipeline_t::shade_batch(geometry_batch_t& batch, const geometry_draw_t& draw, uint32_t instance_id, uint32_t num_carried)
+{
+    const uint32_t num_vertices = m_transformation->get_num_fetched_vertices();
+    const uint32_t vertex_stride = m_transformation->get_vertex_shader()->get_out_vertex_stride();
+    const uint64_t vertex_size_bytes = (uint64_t)num_vertices * vertex_stride;
+    if (vertex_size_bytes > batch.vertex_memory.get_memory_size_bytes())
+    {
+        batch.vertex_memory.preallocate(vertex_size_bytes);
+    }
+    batch.vertices = { };
+    batch.vertices.vertices_base = batch.vertex_memory.get_base_address();
+    batch.vertices.max_vertices = num_vertices;
+    // number of unique vertices to shade for the batch.
+    batch.vertices.num_vertices = num_vertices;
+
+    // transform our vertices with the provided vertex shader.
+    m_transformation->transform(&batch.vertices, instance_id, draw.first_instance);
+
+    // The clipper clips any vertices that won't be in the clip/view volume.
+    // If all vertices of the triangle are clipped, then that triangle is considered culled.
+    m_clipper->clip_cull(&batch.vertices);
+
+    // Primitive generator creates our triangles, lines or points, from the shaded vertices.
+    m_primitive_assembler->assemble(&batch.vertices, draw.topology, num_carried);
+    batch.num_primitives = batch.vertices.num_indices / primitive_assembler_t::vertices_per_primitive(draw.topology);
+
+    // The index list belongs to the transformation or the assembler, which move on to the next batch. 
+    // So keep a copy with the batch.
+    if (batch.vertices.indices)
+    {
+        const uint64_t index_size_bytes = (uint64_t)batch.vertices.num_indices * sizeof(uint32_t);
+        if (index_size_bytes > batch.index_memory.get_memory_size_bytes())
+        {
+            batch.index_memory.preallocate(index_size_bytes);
+        }
+        memcpy((void*)batch.index_memory.get_base_address(), batch.vertices.indices, index_size_bytes);
+        batch.vertices.indices = (const uint32_t*)batch.index_memory.get_base_address();
+    }
+}
+
+
+uint32_t geometry_pipeline_t::fetch_batch(const geometry_draw_t& draw, uint32_t begin)
+{
+    // Carry the incomplete primitive of the previous batch over.
+    uint32_t carried[3];
+    const uint32_t num_carried = m_primitive_assembler->get_num_carried();
+    for (uint32_t corner = 0; corner < num_carried; ++corner)
+    {
+        carried[corner] = m_transformation->get_fetched_vertex_id(m_primitive_assembler->get_carried(corner));
+    }
+    const uint32_t count = minimum<uint32_t>(SWRAST_DRAW_BATCH_SIZE, draw.num_indices - begin);
+    m_transformation->fetch_batch(begin, count, carried, num_carried);
+    return num_carried;
+}
+
+
+void geometry_pipeline_t::run_geometry(const geometry_draw_t& draw)
+{
+    for (uint32_t instance_id = 0; instance_id < draw.instance_count; ++instance_id)
+    {
+        m_primitive_assembler->reset();
+        for (uint32_t begin = 0; begin < draw.num_indices; begin += SWRAST_DRAW_BATCH_SIZE)
+        {
+            const uint32_t num_carried = fetch_batch(draw, begin);
+            const uint32_t batch_index = m_free_batches.pop_wait();
+            shade_batch(m_batches[batch_index], draw, instance_id, num_carried);
+            m_ready_batches.push_wait(batch_index);
+        }
+    }
+    m_ready_batches.push_wait(SWRAST_GEOMETRY_PIPELINE_DEPTH);
+}
+
+
+void geometry_pipeline_t::geometry_job(void* data, uint32_t, uint32_t)
+{
+    geometry_pipeline_t* pipeline = (geometry_pipeline_t*)data;
+    pipeline->run_geometry(pipeline->m_pipelined_draw);
+}
+
+
+error_t geometry_pipeline_t::draw(const geometry_draw_t& draw, rasterizer_t& rasterizer, front_face_t winding_order)
+{
+    const uint32_t vertices_per_primitive = primitive_assembler_t::vertices_per_primitive(draw.topology);
+
+    // Draws that fit in a single batch are fetched once, and shared by all instances. Since there is nothing 
+    // to overlap with, their geometry runs on the calling thread. So do all draws, without a worker to run the 
+    // geometry job. Vertex shading and rasterization are still spread over the job system.
+    const bool single_batch = (draw.num_indices <= SWRAST_DRAW_BATCH_SIZE);
+    if (single_batch || m_job_system->get_num_workers() == 0)
+    {
+        geometry_batch_t& batch = m_batches[0];
+        if (single_batch)
+        {
+            m_transformation->fetch_batch(0, draw.num_indices, nullptr, 0);
+        }
+        for (uint32_t instance_id = 0; instance_id < draw.instance_count; ++instance_id)
+        {
+            m_primitive_assembler->reset();
+            for (uint32_t begin = 0; begin < draw.num_indices; begin += SWRAST_DRAW_BATCH_SIZE)
+            {
+                const uint32_t num_carried = single_batch ? 0 : fetch_batch(draw, begin);
+                shade_batch(batch, draw, instance_id, num_carried);
+                rasterizer.raster(batch.num_primitives, vertices_per_primitive, batch.vertices, winding_order);
+            }
+        }
+        return result_ok;
+    }
+
+    // Kick the geometry stage, and rasterize batches as they come in. The calling thread only waits on the queue, 
+    // and never runs the geometry job itself, which would block on the batches it is supposed to free.
+    m_pipelined_draw = draw;
+    std::atomic<uint32_t> geometry_done(1);
+    job_t job = { };
+    job.function = &geometry_job;
+    job.data = this;
+    job.counter = &geometry_done;
+    m_job_system->submit(job);
+    for (;;)
+    {
+        const uint32_t batch_index = m_ready_batches.pop_wait();
+        if (batch_index == SWRAST_GEOMETRY_PIPELINE_DEPTH)
+        {
+            break;
+        }
+        geometry_batch_t& batch = m_batches[batch_index];
+        // finally rasterize onto framebuffer. Primitives are left in clip space,
+        // so the rasterizer will convert them into ndc, for which they will then 
+        // be projected into screen space.
+        rasterizer.raster(batch.num_primitives, vertices_per_primitive, batch.vertices, winding_order);
+        m_free_batches.push_wait(batch_index);
+    }
+    m_job_system->wait(geometry_done);
+    return result_ok;
+}
+} // swrast
@@ -0,0 +1,77 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "InputAssembly.hpp"
+#include "Rasterizer.hpp"
+#include "Memory.hpp"
+#include "Queue.hpp"
+#include "JobSystem.hpp"
+
+namespace swrast {
+
+
+// Number of batches in flight, between the geometry and raster stages.
+#define SWRAST_GEOMETRY_PIPELINE_DEPTH 4
+
+
+// A shaded and assembled batch, ready to be rasterized. Owns its memory, so the geometry stage 
+// can move on to the next batch, while this one is still being rasterized.
+struct geometry_batch_t
+{
+    vertices_t      vertices;
+    uint32_t        num_primitives;
+    memory_pool_t   vertex_memory;
+    memory_pool_t   index_memory;
+};
+
+
+struct geometry_draw_t
+{
+    uint32_t                num_indices;
+    uint32_t                instance_count;
+    uint32_t                first_instance;
+    primitive_topology_t    topology;
+};
+
+
+// Geometry pipeline runs the front end (fetch, vertex shading, clipping and primitive assembly) of a draw 
+// in batches, and feeds them to the rasterizer. Draws larger than a single batch are pipelined: the 
+// geometry stage runs as a job on the job system, and is connected to the raster stage, on the calling thread, 
+// by lock free queues. So shading of batch N + 1 overlaps with rasterization of batch N.
+class geometry_pipeline_t
+{
+public:
+    error_t initialize(vertex_transformation_t* transformation, clipper_t* clipper, primitive_assembler_t* primitive_assembler, job_system_t* job_system);
+    error_t release();
+
+    // Run the draw. Returns once every batch of the draw has been rasterized.
+    error_t draw(const geometry_draw_t& draw, rasterizer_t& rasterizer, front_face_t winding_order);
+
+private:
+    // Geometry stage of the pipelined draw. Fills batches, and pushes them to the raster stage.
+    static void geometry_job(void* data, uint32_t begin, uint32_t end);
+    void run_geometry(const geometry_draw_t& draw);
+
+    // Fetch the batch of the draw starting at begin, with the incomplete primitive of the previous 
+    // batch carried over. Returns the number of carried vertices.
+    uint32_t fetch_batch(const geometry_draw_t& draw, uint32_t begin);
+
+    // Shade, clip and assemble the fetched vertices into the batch, for the given instance.
+    void shade_batch(geometry_batch_t& batch, const geometry_draw_t& draw, uint32_t instance_id, uint32_t num_carried);
+
+    vertex_transformation_t*    m_transformation = nullptr;
+    clipper_t*                  m_clipper = nullptr;
+    primitive_assembler_t*      m_primitive_assembler = nullptr;
+    job_system_t*               m_job_system = nullptr;
+
+    geometry_batch_t            m_batches[SWRAST_GEOMETRY_PIPELINE_DEPTH];
+    // Batches ready to be rasterized, and batches free to be filled. The end of a draw is 
+    // marked with SWRAST_GEOMETRY_PIPELINE_DEPTH in the ready queue.
+    spsc_queue_t<uint32_t, 2 * SWRAST_GEOMETRY_PIPELINE_DEPTH> m_ready_batches;
+    spsc_queue_t<uint32_t, 2 * SWRAST_GEOMETRY_PIPELINE_DEPTH> m_free_batches;
+
+    // Draw being run by the geometry job.
+    geometry_draw_t             m_pipelined_draw;
+};
+} // swrast
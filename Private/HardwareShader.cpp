@@ -1,7 +1,10 @@
 //
 #include "HardwareShader.hpp"
+#include "FormatConversion.hpp"
 #include "Shader.hpp"
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
 
 namespace swrast {
 
@@ -234,6 +237,150 @@ uint3_t pixel_shader_t::texture_size(uintptr_t texture_handle)
 }
 
 
+// Address of an element of an unordered access view, or 0 when the slot is unbound, or the coordinate outside 
+// of the resource.
+static
+uintptr_t unordered_access_element(const shader_bindings_t* bindings, uint32_t slot, const uint3_t& coord)
+{
+    if (!bindings || slot >= SWRAST_MAX_UNORDERED_ACCESS_VIEWS || !bindings->unordered_access[slot])
+    {
+        return 0;
+    }
+    const resource_t resource = bindings->unordered_access[slot];
+    const resource_desc_t* desc = (const resource_desc_t*)(resource - sizeof(resource_desc_t));
+    if (coord[0] >= desc->width || coord[1] >= desc->height || coord[2] >= desc->depth_or_array_size)
+    {
+        return 0;
+    }
+    const uintptr_t index = ((uintptr_t)coord[2] * desc->height + coord[1]) * desc->width + coord[0];
+    return resource + index * format_size_bytes(desc->format);
+}
+
+
+// Element of an unordered access view atomics work on, or nullptr.
+static
+std::atomic<uint32_t>* atomic_element(const shader_bindings_t* bindings, uint32_t slot, const uint3_t& coord)
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "atomics are done in place, on the elements");
+    const uintptr_t element = unordered_access_element(bindings, slot, coord);
+    if (!element || ((const resource_desc_t*)(bindings->unordered_access[slot] - sizeof(resource_desc_t)))->format != format_r32_uint)
+    {
+        return nullptr;
+    }
+    return (std::atomic<uint32_t>*)element;
+}
+
+
+float4_t i_shader_t::image_load(uint32_t slot, const uint3_t& coord) const
+{
+    float4_t value = float4_t(0.f, 0.f, 0.f, 0.f);
+    const uintptr_t element = unordered_access_element(bindings, slot, coord);
+    if (element)
+    {
+        const format_t format = ((const resource_desc_t*)(bindings->unordered_access[slot] - sizeof(resource_desc_t)))->format;
+        decode_element(format, (const void*)element, &value);
+        if (format == format_r16_uint || format == format_r32_uint)
+        {
+            // Decoded as uint bits, the value is returned as a float, like the other formats.
+            uint32_t bits;
+            memcpy(&bits, &value[0], sizeof(bits));
+            value[0] = (float)bits;
+        }
+    }
+    return value;
+}
+
+
+void i_shader_t::image_store(uint32_t slot, const uint3_t& coord, const float4_t& value) const
+{
+    const uintptr_t element = unordered_access_element(bindings, slot, coord);
+    if (element)
+    {
+        encode_element(((const resource_desc_t*)(bindings->unordered_access[slot] - sizeof(resource_desc_t)))->format, value, (void*)element);
+    }
+}
+
+
+uint3_t i_shader_t::image_size(uint32_t slot) const
+{
+    if (bindings && slot < SWRAST_MAX_UNORDERED_ACCESS_VIEWS && bindings->unordered_access[slot])
+    {
+        const resource_desc_t* desc = (const resource_desc_t*)(bindings->unordered_access[slot] - sizeof(resource_desc_t));
+        return uint3_t(desc->width, desc->height, desc->depth_or_array_size);
+    }
+    return uint3_t(0, 0, 0);
+}
+
+
+uint32_t i_shader_t::image_load_uint(uint32_t slot, const uint3_t& coord) const
+{
+    const uintptr_t element = unordered_access_element(bindings, slot, coord);
+    if (!element)
+    {
+        return 0;
+    }
+    switch (((const resource_desc_t*)(bindings->unordered_access[slot] - sizeof(resource_desc_t)))->format)
+    {
+        case format_r32_uint:
+            return ((const std::atomic<uint32_t>*)element)->load();
+        case format_r16_uint:
+            return *(const uint16_t*)element;
+        default:
+            break;
+    }
+    return 0;
+}
+
+
+uint32_t i_shader_t::atomic_add(uint32_t slot, const uint3_t& coord, uint32_t value) const
+{
+    std::atomic<uint32_t>* element = atomic_element(bindings, slot, coord);
+    return element ? element->fetch_add(value) : 0;
+}
+
+
+uint32_t i_shader_t::atomic_min(uint32_t slot, const uint3_t& coord, uint32_t value) const
+{
+    std::atomic<uint32_t>* element = atomic_element(bindings, slot, coord);
+    if (!element)
+    {
+        return 0;
+    }
+    uint32_t original = element->load();
+    while (value < original && !element->compare_exchange_weak(original, value))
+    {
+    }
+    return original;
+}
+
+
+uint32_t i_shader_t::atomic_max(uint32_t slot, const uint3_t& coord, uint32_t value) const
+{
+    std::atomic<uint32_t>* element = atomic_element(bindings, slot, coord);
+    if (!element)
+    {
+        return 0;
+    }
+    uint32_t original = element->load();
+    while (value > original && !element->compare_exchange_weak(original, value))
+    {
+    }
+    return original;
+}
+
+
+uint32_t i_shader_t::atomic_compare_exchange(uint32_t slot, const uint3_t& coord, uint32_t compare, uint32_t value) const
+{
+    std::atomic<uint32_t>* element = atomic_element(bindings, slot, coord);
+    if (!element)
+    {
+        return 0;
+    }
+    element->compare_exchange_strong(compare, value);
+    return compare;
+}
+
+
 float3_t pixel_shader_t::reflect(float3_t incidence, float3_t normal)
 {
     // Reflection taken from GLSL references:
@@ -321,6 +468,9 @@ void store_color(uintptr_t texel, const float4_t& color, format_t format)
             *output = color.r;
             break;
         }
+        // Other formats can't be written to.
+        default:
+            break;
     }
 }
 
@@ -353,6 +503,10 @@ float4_t load_color(uintptr_t texel, format_t format)
             color = *((float4_t*)texel);
             break;
         }
+        // Other formats read as 0.
+        default:
+            color = float4_t(0.f, 0.f, 0.f, 0.f);
+            break;
     }
     return color;
 }
@@ -1,6 +1,8 @@
 //
 #include "InputAssembly.hpp"
+#include "FormatConversion.hpp"
 #include <memory>
+#include <cstring>
 
 namespace swrast {
 
@@ -11,12 +13,19 @@ size_t format_size_bytes(format_t format)
     {
         case format_r16g16_float:
         case format_r32_float:
+        case format_r32_uint:
         case format_r8g8b8a8_unorm:
         case format_r11g11b10_float:
+        case format_r16g16_snorm:
+        case format_r16g16_unorm:
+        case format_r10g10b10a2_unorm:
+        case format_r16g16_snorm_octahedral:
             return 4ull;
 
         case format_r16g16b16a16_float:
         case format_r32g32_float:
+        case format_r16g16b16a16_snorm:
+        case format_r16g16b16a16_unorm:
             return 8ull;
 
         case format_r32g32b32a32_float:
@@ -25,6 +34,10 @@ size_t format_size_bytes(format_t format)
         case format_r32g32b32_float:
             return 12ull;
 
+        case format_r16_uint:
+        case format_r16_float:
+            return 2ull;
+
         case format_r8_unorm:
             return 1ull;
     }
@@ -80,51 +93,246 @@ error_t input_assembler_t::release()
 }
 
 
-error_t vertex_transformation_t::transform(vertices_t* in_vertices, uint32_t first_vertex, uint32_t num_vertices)
+// Grow the memory pool, if it can not hold the requested size.
+static void reserve_pool(memory_pool_t& pool, uint64_t size_bytes)
+{
+    if (size_bytes > pool.get_memory_size_bytes())
+    {
+        pool.preallocate(size_bytes);
+    }
+}
+
+
+// Decode the per vertex elements of the given vertex into the input record. Per instance elements are filled in at transform.
+static void fetch_record(const input_layout* layout, const resource_t* vertex_buffers, uintptr_t record, uint32_t vertex)
+{
+    for (uint32_t element_i = 0; element_i < layout->num_elements; ++element_i)
+    {
+        const input_element_layout_t& element = layout->elements[element_i];
+        const input_buffer_desc& slot = layout->input_slots[element.input_slot];
+        if (slot.classification == input_classification_per_vertex)
+        {
+            uintptr_t in_element_ptr = vertex_buffers[element.input_slot] + vertex * slot.stride_bytes + element.offset_bytes;
+            decode_element(element.format, (const void*)in_element_ptr, (void*)(record + element.record_offset_bytes));
+        }
+    }
+}
+
+
+void vertex_transformation_t::begin_draw(bool indexed_draw, uint32_t first, uint32_t base_vertex)
+{
+    indexed = indexed_draw;
+    draw_first = first;
+    draw_base_vertex = base_vertex;
+}
+
+
+uint32_t vertex_transformation_t::fetch_cached(uint32_t index, uint64_t generation)
+{
+    // Repeated indices hit the post transform cache, and reference the same shaded vertex.
+    vertex_cache_entry_t& entry = vertex_cache[index & (SWRAST_VERTEX_CACHE_SIZE - 1)];
+    const uint64_t tag = generation | index;
+    if (entry.tag != tag)
+    {
+        uint32_t* vertex_ids = (uint32_t*)input_vertex_ids.get_base_address();
+        uintptr_t record = input_records.get_base_address() + num_fetched_records * input_layout->record_stride_bytes;
+        fetch_record(input_layout, vertex_buffers, record, draw_base_vertex + index);
+        vertex_ids[num_fetched_records] = index;
+        entry.tag = tag;
+        entry.slot = num_fetched_records++;
+    }
+    return entry.slot;
+}
+
+
+error_t vertex_transformation_t::fetch_batch(uint32_t begin, uint32_t count, const uint32_t* carried, uint32_t num_carried)
+{
+    const uint32_t record_stride = input_layout->record_stride_bytes;
+    const uint32_t num_indices = num_carried + count;
+    // Worst case, every index references a unique vertex.
+    reserve_pool(input_records, (uint64_t)num_indices * record_stride);
+    reserve_pool(input_vertex_ids, (uint64_t)num_indices * sizeof(uint32_t));
+    uint32_t* vertex_ids = (uint32_t*)input_vertex_ids.get_base_address();
+    num_fetched_records = 0;
+    num_primitive_indices = num_indices;
+
+    if (!indexed)
+    {
+        // Vertices are fetched in primitive order, carried vertices first.
+        for (uint32_t carried_i = 0; carried_i < num_carried; ++carried_i)
+        {
+            uintptr_t record = input_records.get_base_address() + num_fetched_records * record_stride;
+            fetch_record(input_layout, vertex_buffers, record, carried[carried_i]);
+            vertex_ids[num_fetched_records++] = carried[carried_i];
+        }
+        for (uint32_t vert_id = draw_first + begin; vert_id < draw_first + begin + count; ++vert_id)
+        {
+            uintptr_t record = input_records.get_base_address() + num_fetched_records * record_stride;
+            fetch_record(input_layout, vertex_buffers, record, vert_id);
+            vertex_ids[num_fetched_records++] = vert_id;
+        }
+        return result_ok;
+    }
+
+    reserve_pool(primitive_indices, (uint64_t)num_indices * sizeof(uint32_t));
+    uint32_t* slots = (uint32_t*)primitive_indices.get_base_address();
+    // Slots only live as long as the batch, so every batch starts a new cache generation.
+    const uint64_t generation = (++vertex_cache_generation) << 32;
+    for (uint32_t carried_i = 0; carried_i < num_carried; ++carried_i)
+    {
+        slots[carried_i] = fetch_cached(carried[carried_i], generation);
+    }
+
+    uintptr_t ib_base = index_buffer;
+    const uint32_t index_size = (uint32_t)format_size_bytes(index_format);
+    // Restart value can never be hit, if primitive restart is disabled.
+    const uint64_t restart_value = !primitive_restart 
+        ? UINT64_MAX 
+        : (index_format == format_r16_uint ? 0xFFFFull : 0xFFFFFFFFull);
+    for (uint32_t index_id = 0; index_id < count; ++index_id)
+    {
+        // Instead of using vertex id like the non indexed path, we instead use the index value from the index buffer.
+        const uintptr_t index_address = ib_base + (draw_first + begin + index_id) * index_size;
+        const uint32_t index = (index_format == format_r16_uint) ? *((uint16_t*)index_address) : *((uint32_t*)index_address);
+        // Restarts are not fetched, the primitive assembler will cut the strip here.
+        slots[num_carried + index_id] = (index == restart_value) ? SWRAST_RESTART_INDEX : fetch_cached(index, generation);
+    }
+    return result_ok;
+}
+
+
+error_t vertex_transformation_t::transform(vertices_t* in_vertices, uint32_t instance_id, uint32_t first_instance)
 {
     // Set information about the vertex stream.
     in_vertices->pos_offset = vertex_shader->get_out_pos_offset_bytes();
     in_vertices->vertex_stride = vertex_shader->get_out_vertex_stride();
-    // for each drawing vertex, we will invoke the vertex shader. This might be able to be done in 
-    // a certain batch, rather than individually!
-    // The number of vertex buffers bound will also determine the number of input slots to use for each of them.
-    for (uint input_slot_index = 0; input_slot_index < input_layout->num_vbs; ++input_slot_index)
-    {
-        // Get the vertex buffer bases, for which we will begin reading from.
-        uintptr_t vb_base = vertex_buffers[input_slot_index];
-        for (uint32_t vert_id = 0; vert_id < num_vertices; ++vert_id)
+    in_vertices->viewport_index_offset = vertex_shader->get_out_viewport_index_offset_bytes();
+    in_vertices->render_target_array_index_offset = vertex_shader->get_out_render_target_array_index_offset_bytes();
+    in_vertices->view_pos_offset = vertex_shader->get_out_view_pos_offset_bytes();
+    in_vertices->indices = indexed ? (const uint32_t*)primitive_indices.get_base_address() : nullptr;
+    in_vertices->num_indices = num_primitive_indices;
+    vertex_shader->set_view_count(view_count);
+
+    const uint32_t record_stride = input_layout->record_stride_bytes;
+    const uintptr_t records_base = input_records.get_base_address();
+    const uint32_t* vertex_ids = (const uint32_t*)input_vertex_ids.get_base_address();
+
+    // Per instance elements are the same for every vertex of this instance, so they are decoded once, and only 
+    // patched into the fetched records. Per vertex data is reused as is.
+    if (input_layout->has_instance_slots)
+    {
+        for (uint32_t element_i = 0; element_i < input_layout->num_elements; ++element_i)
+        {
+            const input_element_layout_t& element = input_layout->elements[element_i];
+            const input_buffer_desc& slot = input_layout->input_slots[element.input_slot];
+            if (slot.classification == input_classification_per_instance)
+            {
+                const uint32_t step_rate = slot.step_rate ? slot.step_rate : 1;
+                uintptr_t in_element_ptr = vertex_buffers[element.input_slot] 
+                    + (first_instance + instance_id / step_rate) * slot.stride_bytes + element.offset_bytes;
+                uint32_t decoded[4];
+                decode_element(element.format, (const void*)in_element_ptr, decoded);
+                const uint32_t decoded_size = format_decoded_size_bytes(element.format);
+                for (uint32_t record_id = 0; record_id < num_fetched_records; ++record_id)
+                {
+                    memcpy((void*)(records_base + record_id * record_stride + element.record_offset_bytes), decoded, decoded_size);
+                }
+            }
+        }
+    }
+
+    // Vertices are shaded in parallel, in chunks. Shaders that support it, are invoked in batches instead.
+    if (vertex_shader->supports_batch_execution())
+    {
+        // float8_t must be 32 byte aligned, so allocate a bit more than needed, and align each thread's base.
+        const uint32_t num_values = (record_stride + in_vertices->vertex_stride) / sizeof(float);
+        batch_scratch_stride = (uint64_t)num_values * sizeof(float8_t) + alignof(float8_t);
+        reserve_pool(batch_scratch, batch_scratch_stride * job_system->get_num_thread_indices());
+        job_system->parallel_for(num_fetched_records, SWRAST_VERTEX_SHADE_JOB_SIZE, [&] (uint32_t begin, uint32_t end)
+        {
+            transform_batched(in_vertices, instance_id, begin, end);
+        });
+        return result_ok;
+    }
+
+    job_system->parallel_for(num_fetched_records, SWRAST_VERTEX_SHADE_JOB_SIZE, [&] (uint32_t begin, uint32_t end)
+    {
+        // for each drawing vertex, we will invoke the vertex shader.
+        for (uint32_t record_id = begin; record_id < end; ++record_id)
         {
             // Get the input vertex to read, and output vertex to write to.
-            uintptr_t output_offset_vertex = vert_id * in_vertices->vertex_stride;
-            uintptr_t in_vertex_ptr = vb_base + (first_vertex + vert_id) * input_layout->input_slots[input_slot_index].stride_bytes;
-            uintptr_t out_vertex_ptr = in_vertices->vertices_base + output_offset_vertex;
+            uintptr_t in_vertex_ptr = records_base + record_id * record_stride;
+            uintptr_t out_vertex_ptr = in_vertices->vertices_base + record_id * in_vertices->vertex_stride;
             // execute the vertex shader.
-            vertex_shader->execute(in_vertex_ptr, out_vertex_ptr, vert_id);
+            vertex_shader->execute(in_vertex_ptr, out_vertex_ptr, vertex_ids[record_id], instance_id);
         }
-    }
+    });
     return result_ok;
 }
 
 
-error_t vertex_transformation_t::transform_indexed(vertices_t* in_vertices, uint32_t first_index, uint32_t first_vertex, uint32_t num_indices)
+void vertex_transformation_t::transform_batched(vertices_t* in_vertices, uint32_t instance_id, uint32_t begin, uint32_t end)
 {
-    uintptr_t ib_base = index_buffer;
-    in_vertices->pos_offset = vertex_shader->get_out_pos_offset_bytes();
-    in_vertices->vertex_stride = vertex_shader->get_out_vertex_stride();
-    for (uint input_slot_index = 0; input_slot_index < input_layout->num_vbs; ++input_slot_index)
+    const uint32_t record_stride = input_layout->record_stride_bytes;
+    const uint32_t vertex_stride = in_vertices->vertex_stride;
+    const uint32_t num_in_values = record_stride / sizeof(float);
+    const uint32_t num_out_values = vertex_stride / sizeof(float);
+    const uintptr_t records_base = input_records.get_base_address();
+    const uint32_t* vertex_ids = (const uint32_t*)input_vertex_ids.get_base_address();
+
+    // Structure of arrays scratch of the calling thread.
+    const uintptr_t thread_scratch = batch_scratch.get_base_address() + job_system_t::get_thread_index() * batch_scratch_stride;
+    const uintptr_t scratch_base = (thread_scratch + alignof(float8_t) - 1) & ~(uintptr_t)(alignof(float8_t) - 1);
+    float8_t* in_soa = (float8_t*)scratch_base;
+    float8_t* out_soa = in_soa + num_in_values;
+
+    vertex_batch_t batch = { };
+    batch.instance_id = instance_id;
+    batch.in = in_soa;
+    batch.out = out_soa;
+    for (uint32_t first_record = begin; first_record < end; first_record += SWRAST_VERTEX_BATCH_SIZE)
     {
-        // Similar to the tranform(), number of vbs bound determines the input slot to use.
-        uintptr_t vb_base = vertex_buffers[input_slot_index];
-        for (uint index_id = 0; index_id < num_indices; ++index_id)
+        batch.count = minimum<uint32_t>(SWRAST_VERTEX_BATCH_SIZE, end - first_record);
+
+        // Transpose the input records into structure of arrays. Unused lanes repeat the last vertex.
+        const float* lanes[SWRAST_VERTEX_BATCH_SIZE];
+        for (uint32_t lane = 0; lane < SWRAST_VERTEX_BATCH_SIZE; ++lane)
+        {
+            const uint32_t record_id = first_record + minimum<uint32_t>(lane, batch.count - 1);
+            lanes[lane] = (const float*)(records_base + record_id * record_stride);
+            batch.vert_ids[lane] = vertex_ids[record_id];
+        }
+        for (uint32_t value = 0; value < num_in_values; ++value)
         {
-            uintptr_t output_offset_vertex = index_id * in_vertices->vertex_stride;
-            // Instead of using vertex id like transform, we instead use the index value from the index buffer.
-            uint32_t index = *((uint32_t*)(ib_base + (first_index + index_id) * 4));
-            uintptr_t in_vertex_ptr = vb_base + ((first_vertex + index) * input_layout->input_slots[input_slot_index].stride_bytes);
-            uintptr_t out_vertex_ptr = in_vertices->vertices_base + output_offset_vertex;
-            vertex_shader->execute(in_vertex_ptr, out_vertex_ptr, index_id);
+            in_soa[value] = float8_t(_mm256_setr_ps(lanes[0][value], lanes[1][value], lanes[2][value], lanes[3][value],
+                                                    lanes[4][value], lanes[5][value], lanes[6][value], lanes[7][value]));
         }
+
+        vertex_shader->execute_batch(batch);
+
+        // Transpose the outputs back into the vertex pool.
+        for (uint32_t value = 0; value < num_out_values; ++value)
+        {
+            alignas(32) float out_lanes[SWRAST_VERTEX_BATCH_SIZE];
+            _mm256_store_ps(out_lanes, out_soa[value].v);
+            for (uint32_t lane = 0; lane < batch.count; ++lane)
+            {
+                float* out_vertex = (float*)(in_vertices->vertices_base + (first_record + lane) * vertex_stride);
+                out_vertex[value] = out_lanes[lane];
+            }
+        }
+    }
+}
+
+
+error_t vertex_transformation_t::bind_index_buffer(resource_t resource, format_t format)
+{
+    if (format != format_r16_uint && format != format_r32_uint)
+    {
+        return result_failed;
     }
+    index_buffer = resource;
+    index_format = format;
     return result_ok;
 }
 
@@ -141,20 +349,188 @@ error_t vertex_transformation_t::bind_vertex_buffers(uint32_t num_vbs, resource_
 
 
 
-input_layout* input_assembler_t::create_input_layout(uint32_t num_elements, input_element_desc* descs)
+error_t primitive_assembler_t::release()
+{
+    assembled_indices.release();
+    return result_ok;
+}
+
+
+void primitive_assembler_t::reset()
+{
+    num_corners = 0;
+    strip_triangle = 0;
+}
+
+
+error_t primitive_assembler_t::assemble(vertices_t* inout_vertices, primitive_topology_t topology, uint32_t num_carried)
+{
+    const uint32_t* indices = inout_vertices->indices;
+    const uint32_t num_indices = inout_vertices->num_indices;
+    const uint32_t list_corners = vertices_per_primitive(topology);
+    bool has_restart = false;
+    if (indices)
+    {
+        for (uint32_t i = 0; i < num_indices && !has_restart; ++i)
+        {
+            has_restart = (indices[i] == SWRAST_RESTART_INDEX);
+        }
+    }
+
+    // Lists without cuts are already assembled.
+    const bool is_list = (topology == primitive_topology_trianglelist) 
+                      || (topology == primitive_topology_lines) 
+                      || (topology == primitive_topology_points);
+    if (is_list && !has_restart)
+    {
+        // Carry the incomplete primitive at the end, if any, over to the next batch.
+        num_corners = num_indices % list_corners;
+        for (uint32_t corner = 0; corner < num_corners; ++corner)
+        {
+            const uint32_t i = num_indices - num_corners + corner;
+            corners[corner] = indices ? indices[i] : i;
+        }
+        return result_ok;
+    }
+
+    // A strip with N vertices generates N - 2 triangles, so the list never needs more than 3x the indices.
+    const uint64_t size_bytes = (uint64_t)num_indices * 3 * sizeof(uint32_t);
+    if (size_bytes > assembled_indices.get_memory_size_bytes())
+    {
+        assembled_indices.preallocate(size_bytes);
+    }
+    uint32_t* out = (uint32_t*)assembled_indices.get_base_address();
+    uint32_t num_out = 0;
+
+    // The vertices carried over from the previous batch are the first ones of this batch, 
+    // and continue the primitive that was being assembled.
+    for (uint32_t corner = 0; corner < num_carried; ++corner)
+    {
+        corners[corner] = indices ? indices[corner] : corner;
+    }
+    for (uint32_t i = num_carried; i < num_indices; ++i)
+    {
+        const uint32_t index = indices ? indices[i] : i;
+        if (index == SWRAST_RESTART_INDEX)
+        {
+            num_corners = 0;
+            strip_triangle = 0;
+            continue;
+        }
+        switch (topology)
+        {
+            case primitive_topology_trianglestrip:
+            {
+                if (num_corners < 2)
+                {
+                    corners[num_corners++] = index;
+                    break;
+                }
+                // Every odd triangle swaps its first two vertices, in order to keep the same winding order.
+                const bool odd = (strip_triangle++ & 1) != 0;
+                out[num_out++] = odd ? corners[1] : corners[0];
+                out[num_out++] = odd ? corners[0] : corners[1];
+                out[num_out++] = index;
+                corners[0] = corners[1];
+                corners[1] = index;
+                break;
+            }
+            case primitive_topology_trianglefan:
+            {
+                if (num_corners < 2)
+                {
+                    corners[num_corners++] = index;
+                    break;
+                }
+                // The first vertex is shared by every triangle in the fan.
+                out[num_out++] = corners[0];
+                out[num_out++] = corners[1];
+                out[num_out++] = index;
+                corners[1] = index;
+                break;
+            }
+            case primitive_topology_linestrip:
+            {
+                if (num_corners < 1)
+                {
+                    corners[num_corners++] = index;
+                    break;
+                }
+                out[num_out++] = corners[0];
+                out[num_out++] = index;
+                corners[0] = index;
+                break;
+            }
+            case primitive_topology_trianglelist:
+            case primitive_topology_lines:
+            case primitive_topology_points:
+            default:
+            {
+                corners[num_corners++] = index;
+                if (num_corners == list_corners)
+                {
+                    for (uint32_t corner = 0; corner < list_corners; ++corner)
+                    {
+                        out[num_out++] = corners[corner];
+                    }
+                    num_corners = 0;
+                }
+                break;
+            }
+        }
+    }
+    inout_vertices->indices = out;
+    inout_vertices->num_indices = num_out;
+    return result_ok;
+}
+
+
+uint32_t primitive_assembler_t::vertices_per_primitive(primitive_topology_t topology)
+{
+    switch (topology)
+    {
+        case primitive_topology_points:
+            return 1;
+        case primitive_topology_lines:
+        case primitive_topology_linestrip:
+            return 2;
+        default:
+            break;
+    }
+    return 3;
+}
+
+
+error_t input_assembler_t::build_input_layout(uint32_t num_elements, const input_element_desc* descs, input_layout& layout)
 {
-    input_layout* layout = new input_layout();
-    layout->input_slots[0].stride_bytes = 0;
+    if (num_elements > SWRAST_MAX_INPUT_ELEMENTS)
+    {
+        return result_failed;
+    }
+    layout.num_elements = num_elements;
     for (uint32_t element_i = 0; element_i < num_elements; ++element_i)
     {
-        input_element_desc& desc = descs[element_i];
+        const input_element_desc& desc = descs[element_i];
         uint32_t index = desc.input_slot;
         uint32_t size_bytes = format_size_bytes(desc.format);
-        layout->input_slots[index].stride_bytes += size_bytes;
+        input_buffer_desc& slot = layout.input_slots[index];
+        // Slots are tightly packed, so the stride ends with the last element.
+        slot.stride_bytes = maximum<uint, uint, uint>(slot.stride_bytes, desc.offset + size_bytes);
+        slot.classification = desc.input_classification;
+        slot.step_rate = desc.instance_data_step_rate;
+        layout.has_instance_slots |= (desc.input_classification == input_classification_per_instance);
+
+        // Elements are decoded into the input record in declaration order, no matter which slot they come from.
+        input_element_layout_t& element = layout.elements[element_i];
+        element.format = desc.format;
+        element.input_slot = index;
+        element.offset_bytes = desc.offset;
+        element.record_offset_bytes = layout.record_stride_bytes;
+        layout.record_stride_bytes += format_decoded_size_bytes(desc.format);
 
         // The maximum index is usually the number of expected vbs.
-        layout->num_vbs = maximum<uint, uint, uint>(layout->num_vbs, index + 1);
+        layout.num_vbs = maximum<uint, uint, uint>(layout.num_vbs, index + 1);
     }
-    return layout;
+    return result_ok;
 }
 } // swrast
\ No newline at end of file
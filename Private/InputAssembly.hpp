@@ -4,19 +4,50 @@
 #include "Math.hpp"
 #include "HardwareShader.hpp"
 #include "Memory.hpp"
+#include "JobSystem.hpp"
 #include <map>
 
 namespace swrast {
 
+// Number of entries in the post transform vertex cache. Must be a power of 2.
+#define SWRAST_VERTEX_CACHE_SIZE 1024
+// Marks a primitive restart, in the post transform index list.
+#define SWRAST_RESTART_INDEX 0xFFFFFFFF
+// Number of indices (or vertices, for non indexed draws) processed per batch. Must be a multiple of 6, 
+// so list primitives never straddle batches, and strips keep their winding parity.
+#define SWRAST_DRAW_BATCH_SIZE 3072
+// Number of vertices shaded by a single job. Must be a multiple of SWRAST_VERTEX_BATCH_SIZE.
+#define SWRAST_VERTEX_SHADE_JOB_SIZE 256
+// Maximum number of elements in an input layout.
+#define SWRAST_MAX_INPUT_ELEMENTS 32
+
 struct input_buffer_desc
 {
     uint32_t stride_bytes;
+    input_classification_t classification;
+    uint32_t step_rate;
+};
+
+struct input_element_layout_t
+{
+    format_t format;
+    uint32_t input_slot;
+    // Offset of the element, within a vertex of its input slot.
+    uint32_t offset_bytes;
+    // Offset of the decoded element, within the input record passed to the vertex shader.
+    uint32_t record_offset_bytes;
 };
 
 struct input_layout
 {
     uint32_t num_vbs;
     input_buffer_desc input_slots[16];
+    uint32_t num_elements;
+    input_element_layout_t elements[SWRAST_MAX_INPUT_ELEMENTS];
+    // Size of the decoded input record, for all elements.
+    uint32_t record_stride_bytes;
+    // Whether any of the slots are stepped per instance.
+    bool has_instance_slots;
 };
 
 // Vertices for pipeline.
@@ -32,12 +63,24 @@ struct vertices_t
     uint32_t    vertex_stride;
     // Offset position.
     uint32_t    pos_offset;
+    // Offset of the viewport index, and render target array index, written by the vertex shader. 
+    // SWRAST_INVALID_OFFSET if the shader does not output them.
+    uint32_t    viewport_index_offset;
+    uint32_t    render_target_array_index_offset;
+    // Offset of the per view clip positions, SWRAST_INVALID_OFFSET if not multi-view.
+    uint32_t    view_pos_offset;
+    // Vertex pool indices that make up the primitives, after the post transform cache. 
+    // nullptr if the vertices are already in primitive order.
+    const uint32_t* indices;
+    uint32_t    num_indices;
     // Allocates a new vertex in the vertices cache. 
     // Returns index of vertex if available, or -1 if the vertex cache is full!
     // 
     uint32_t  allocate_vertex();
     uintptr_t get_vertex(uint32_t index);
     float4_t& get_vertex_position(uint32_t index);
+    // Get the vertex of the given primitive corner, through the index list.
+    uintptr_t get_primitive_vertex(uint32_t corner) { return get_vertex(indices ? indices[corner] : corner); }
 };
 
 // Input assembler is initially supposed to generate the given output vertex buffer that will be used 
@@ -60,20 +103,57 @@ public:
     // additional memory for added triangles during clipping.
     vertices_t get_available_vertex_pool(uint32_t num_vertices_limit, uint32_t vertex_size_bytes);
 
-    input_layout* create_input_layout(uint32_t num_descs, input_element_desc* descs);
+    // Fill a zero initialized layout from its element descriptions.
+    static error_t build_input_layout(uint32_t num_descs, const input_element_desc* descs, input_layout& layout);
 private:
     memory_pool_t                       vertex_pool;
 };
 
 
+// Primitive assembler takes the post transform index list, which references shaded vertices in the vertex pool, 
+// and generates the primitives of the bound topology. Strips and fans are expanded into lists, and primitive 
+// restarts are resolved, so the rasterizer only ever has to deal with triangle, line, and point lists.
+//
+// Draws are assembled in batches. The incomplete primitive at the end of a batch (the last 2 vertices of a strip, 
+// the fan center and last vertex, ...) is carried over, and its vertices are fetched again at the start of the next batch.
+class primitive_assembler_t
+{
+public:
+    error_t release();
+
+    // Reset the assembly state, at the start of a draw.
+    void reset();
+
+    // Assemble the primitives. Vertices indices are replaced with the assembled list, if needed.
+    // The first num_carried vertices are the ones carried over from the previous batch.
+    error_t assemble(vertices_t* inout_vertices, primitive_topology_t topology, uint32_t num_carried);
+
+    // Vertices of the incomplete primitive to carry over to the next batch, as slots in the current vertex pool.
+    uint32_t get_num_carried() const { return num_corners; }
+    uint32_t get_carried(uint32_t corner) const { return corners[corner]; }
+
+    // Number of vertices that make up one primitive of the topology, once assembled.
+    static uint32_t vertices_per_primitive(primitive_topology_t topology);
+
+private:
+    memory_pool_t assembled_indices;
+
+    // Current primitive being assembled. Cut by every restart.
+    uint32_t corners[3] = { 0, 0, 0 };
+    uint32_t num_corners = 0;
+    uint32_t strip_triangle = 0;
+};
+
+
 // Vertex transformation handles transformation of vertices
 // within the vertex allocation. This must reference the object space vertex buffer,
 // as it will be used to generate the needed vertices to clip space.
 class vertex_transformation_t
 {
 public:
-    error_t initialize()
+    error_t initialize(job_system_t* jobs)
     {
+        job_system = jobs;
         return result_ok;
     }
 
@@ -85,25 +165,78 @@ public:
 
     // Bind our vertex buffers. Must be in object space.
     error_t bind_vertex_buffers(uint32_t num_vbs, resource_t* resource);
-    error_t bind_index_buffer(resource_t resource) { index_buffer = resource; return result_ok; }
+    error_t bind_index_buffer(resource_t resource, format_t format);
+    void enable_primitive_restart(bool enable) { primitive_restart = enable; }
     error_t bind_input_layout(input_layout* layout) { input_layout = layout; return result_ok; }
 
-    // Calls to generate and transform our object space vertices into clip space.
+    // Set up a draw. first is the first vertex of non indexed draws, or the first index of indexed draws.
+    void begin_draw(bool indexed_draw, uint32_t first, uint32_t base_vertex);
+
+    // Fetch the per vertex input records of a batch of the draw, from begin to begin + count. The carried vertex 
+    // indices are fetched first. Records are reused by every instance, as long as the draw fits in one batch.
+    error_t fetch_batch(uint32_t begin, uint32_t count, const uint32_t* carried, uint32_t num_carried);
+
+    // Calls to generate and transform our fetched object space vertices into clip space, for the given instance.
     // The input vertex buffers must be in object space, and the output transformation
-    // must be in clip space.
-    error_t transform(vertices_t* in_vertices, uint32_t first_vertex, uint32_t num_vertices);
-    error_t transform_indexed(vertices_t* in_vertices, uint32_t first_index, uint32_t first_vertex, uint32_t num_indices);
+    // must be in clip space. Vertices are shaded in parallel, so the vertex shader may be executed from multiple threads.
+    error_t transform(vertices_t* in_vertices, uint32_t instance_id, uint32_t first_instance);
 
     // Bind the vertex shader to be used for transformation.
     error_t bind_vertex_shader(vertex_shader_t* shader) { vertex_shader = shader; return result_ok; }
     
     vertex_shader_t* get_vertex_shader() { return vertex_shader; }
 
+    // Number of views the vertex shader must output clip positions for.
+    void set_view_count(uint32_t count) { view_count = count; }
+
+    // Number of unique vertices fetched for the current draw. This is what needs to be shaded.
+    uint32_t get_num_fetched_vertices() const { return num_fetched_records; }
+
+    // Vertex index (vertex id) of a fetched record.
+    uint32_t get_fetched_vertex_id(uint32_t slot) const { return ((const uint32_t*)input_vertex_ids.get_base_address())[slot]; }
+
 private:
     input_layout* input_layout;
     resource_t vertex_buffers[16];
     resource_t index_buffer;
+    format_t index_format = format_r32_uint;
+    bool primitive_restart = false;
     uint32_t num_vertex_buffers;
     vertex_shader_t* vertex_shader;
+    uint32_t view_count = 1;
+
+    // Input records fetched for the current draw, and the vertex id of each record.
+    memory_pool_t input_records;
+    memory_pool_t input_vertex_ids;
+    uint32_t num_fetched_records = 0;
+
+    // Post transform vertex cache. Direct mapped, keyed by vertex index. Each entry holds the draw generation 
+    // in the upper 32 bits, and the index in the lower, so the cache never needs to be cleared between draws.
+    struct vertex_cache_entry_t
+    {
+        uint64_t tag;
+        uint32_t slot;
+    };
+    vertex_cache_entry_t vertex_cache[SWRAST_VERTEX_CACHE_SIZE] = { };
+    uint64_t vertex_cache_generation = 0;
+
+    // Fetch the record of the given index, if it is not cached yet. Returns its slot.
+    uint32_t fetch_cached(uint32_t index, uint64_t generation);
+
+    // Shade the fetched records from begin to end in batches, with the vertex shader's execute_batch().
+    void transform_batched(vertices_t* in_vertices, uint32_t instance_id, uint32_t begin, uint32_t end);
+
+    // Structure of arrays scratch memory, for batched shading. One per thread of the job system.
+    memory_pool_t batch_scratch;
+    uint64_t batch_scratch_stride = 0;
+
+    job_system_t* job_system = nullptr;
+
+    // Index list referencing the cached slots. Used for primitive assembly.
+    memory_pool_t primitive_indices;
+    uint32_t num_primitive_indices = 0;
+    bool indexed = false;
+    uint32_t draw_first = 0;
+    uint32_t draw_base_vertex = 0;
 };
 } // swrast
\ No newline at end of file
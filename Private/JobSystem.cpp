@@ -0,0 +1,207 @@
+//
+#include "JobSystem.hpp"
+#include "Topology.hpp"
+
+namespace swrast {
+
+
+// Workers set their index on startup. Every other thread is 0.
+static thread_local uint32_t t_thread_index = 0;
+
+// Number of times an idle worker looks for work, before going to sleep.
+#define SWRAST_JOB_SPIN_COUNT 64
+
+
+uint32_t job_system_t::get_thread_index()
+{
+    return t_thread_index;
+}
+
+
+error_t job_system_t::initialize(uint32_t num_workers, uint32_t thread_affinity)
+{
+    release();
+    m_exit = false;
+    m_row_owners = (thread_affinity & thread_affinity_numa_local_targets) && num_workers > 0;
+    std::vector<cpu_info_t> cpus;
+    if ((thread_affinity & thread_affinity_pin_workers) && query_cpu_topology(cpus) == result_ok)
+    {
+        std::vector<cpu_info_t> selected;
+        select_worker_cpus(cpus, num_workers, selected);
+        for (const cpu_info_t& info : selected)
+        {
+            m_worker_cpus.push_back(info.cpu);
+        }
+    }
+    m_deques.reset(new job_deque_t[num_workers + 1]);
+    m_workers.reserve(num_workers);
+    for (uint32_t worker = 0; worker < num_workers; ++worker)
+    {
+        m_workers.emplace_back([this, worker] () { worker_main(worker + 1); });
+    }
+    return result_ok;
+}
+
+
+error_t job_system_t::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_exit = true;
+    }
+    m_wake.notify_all();
+    for (std::thread& worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+    m_worker_cpus.clear();
+    m_deques.reset();
+    m_num_stealable = 0;
+    return result_ok;
+}
+
+
+void job_system_t::submit(const job_t& job)
+{
+    submit(job, get_thread_index());
+}
+
+
+void job_system_t::submit(const job_t& job, uint32_t thread_index)
+{
+    if (m_workers.empty())
+    {
+        job.function(job.data, job.begin, job.end);
+        job.counter->fetch_sub(1, std::memory_order_release);
+        return;
+    }
+    // Counted before it is queued, so the count never drops below the number of queued jobs.
+    job_deque_t& deque = m_deques[thread_index];
+    std::atomic<uint32_t>& num_queued = (job.flags & job_flag_pinned) ? deque.num_pinned : m_num_stealable;
+    num_queued.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        deque.jobs.push_back(job);
+    }
+    {
+        // Take the lock, so a worker about to sleep can't miss the wake up.
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+    }
+    // Any worker can run an unpinned job. A pinned one needs its owner, which may not be the one woken up.
+    // The others go back to sleep right away, as they only wake up for their own pinned jobs.
+    if (job.flags & job_flag_pinned)
+    {
+        m_wake.notify_all();
+    }
+    else
+    {
+        m_wake.notify_one();
+    }
+}
+
+
+uint32_t job_system_t::get_row_owner(uint32_t row, uint32_t num_rows) const
+{
+    if (!m_row_owners || num_rows == 0)
+    {
+        return get_thread_index();
+    }
+    const uint32_t num_workers = get_num_workers();
+    return 1 + minimum<uint32_t>(num_workers - 1, (uint32_t)((uint64_t)row * num_workers / num_rows));
+}
+
+
+bool job_system_t::try_run_job(uint32_t thread_index)
+{
+    job_deque_t& own = m_deques[thread_index];
+    if (m_num_stealable.load(std::memory_order_acquire) == 0 && own.num_pinned.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+    job_t job = { };
+    bool found = false;
+    {
+        // Own jobs are taken newest first.
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty())
+        {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            found = true;
+        }
+    }
+    // Steal the oldest unpinned job of another deque, starting with the next one, to spread thieves out.
+    const uint32_t num_deques = get_num_thread_indices();
+    for (uint32_t i = 1; i < num_deques && !found; ++i)
+    {
+        job_deque_t& victim = m_deques[(thread_index + i) % num_deques];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        for (std::deque<job_t>::iterator it = victim.jobs.begin(); it != victim.jobs.end(); ++it)
+        {
+            if (!(it->flags & job_flag_pinned))
+            {
+                job = *it;
+                victim.jobs.erase(it);
+                found = true;
+                break;
+            }
+        }
+    }
+    if (!found)
+    {
+        return false;
+    }
+    std::atomic<uint32_t>& num_queued = (job.flags & job_flag_pinned) ? own.num_pinned : m_num_stealable;
+    num_queued.fetch_sub(1, std::memory_order_relaxed);
+    job.function(job.data, job.begin, job.end);
+    job.counter->fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+
+void job_system_t::wait(std::atomic<uint32_t>& counter)
+{
+    const uint32_t thread_index = get_thread_index();
+    while (counter.load(std::memory_order_acquire) != 0)
+    {
+        if (!try_run_job(thread_index))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+
+void job_system_t::worker_main(uint32_t thread_index)
+{
+    t_thread_index = thread_index;
+    if (thread_index - 1 < m_worker_cpus.size())
+    {
+        pin_current_thread(m_worker_cpus[thread_index - 1]);
+    }
+    uint32_t idle_count = 0;
+    while (!m_exit.load(std::memory_order_relaxed))
+    {
+        if (try_run_job(thread_index))
+        {
+            idle_count = 0;
+            continue;
+        }
+        if (++idle_count < SWRAST_JOB_SPIN_COUNT)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        // Jobs pinned to other workers don't wake this one up, only jobs it can run do.
+        const job_deque_t& own = m_deques[thread_index];
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wake.wait(lock, [this, &own] ()
+        {
+            return m_exit.load(std::memory_order_relaxed) || m_num_stealable.load(std::memory_order_acquire) != 0 ||
+                own.num_pinned.load(std::memory_order_acquire) != 0;
+        });
+        idle_count = 0;
+    }
+}
+} // swrast
@@ -0,0 +1,139 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "Math.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace swrast {
+
+
+// A job runs function(data, begin, end), and decrements its counter once done.
+typedef void (*job_function_t)(void* data, uint32_t begin, uint32_t end);
+
+enum job_flags_t
+{
+    job_flag_none = (0),
+    // Only the thread the job was queued on may run it, it is never stolen.
+    job_flag_pinned = (1 << 0)
+};
+
+struct job_t
+{
+    job_function_t          function;
+    void*                   data;
+    uint32_t                begin;
+    uint32_t                end;
+    std::atomic<uint32_t>*  counter;
+    uint32_t                flags;
+};
+
+
+// Work stealing job system, shared by every stage of the pipeline, so parallel stages never oversubscribe the machine.
+// Each worker owns a deque. Workers push and pop their own jobs from the back (newest first, while still in cache), 
+// and steal from the front of other deques when they run out. Threads outside of the job system share the 
+// first deque. Any thread waiting on jobs runs jobs itself, instead of blocking.
+class job_system_t
+{
+public:
+    ~job_system_t() { release(); }
+
+    // Start the worker threads. 0 workers runs every job on the submitting thread.
+    // thread_affinity takes thread_affinity_t flags.
+    error_t initialize(uint32_t num_workers, uint32_t thread_affinity = thread_affinity_none);
+    error_t release();
+
+    uint32_t get_num_workers() const { return (uint32_t)m_workers.size(); }
+
+    // Index of the calling thread, 0 for threads outside the job system, and 1 to num workers for workers. 
+    // Used to index per thread scratch memory.
+    static uint32_t get_thread_index();
+    uint32_t get_num_thread_indices() const { return get_num_workers() + 1; }
+
+    void submit(const job_t& job);
+    // Queue the job on the deque of a given thread. Other threads may still steal it, unless it is pinned.
+    void submit(const job_t& job, uint32_t thread_index);
+
+    // Thread owning a row of a surface num_rows high. With NUMA local targets, rows are split into one band per 
+    // worker, and the worker owning a band touches its memory first, and rasterizes it. Otherwise rows have no 
+    // owner, and this is the calling thread.
+    uint32_t get_row_owner(uint32_t row, uint32_t num_rows) const;
+    bool has_row_owners() const { return m_row_owners; }
+
+    // Wait for the counter to reach 0, running jobs in the meantime.
+    void wait(std::atomic<uint32_t>& counter);
+
+    // Split [0, count) into jobs of grain_size items, and wait for all of them. The calling thread participates.
+    template<typename function_t>
+    void parallel_for(uint32_t count, uint32_t grain_size, const function_t& function)
+    {
+        const uint32_t thread_index = get_thread_index();
+        parallel_for_owned(count, grain_size, [thread_index] (uint32_t) { return thread_index; }, function);
+    }
+
+    // Same as parallel_for, with each job queued on the thread owner(begin) returns.
+    template<typename function_t, typename owner_function_t>
+    void parallel_for_owned(uint32_t count, uint32_t grain_size, const owner_function_t& owner, const function_t& function)
+    {
+        grain_size = maximum<uint32_t>(1u, grain_size);
+        const uint32_t num_jobs = (count + grain_size - 1) / grain_size;
+        if (num_jobs <= 1 || m_workers.empty())
+        {
+            if (count)
+            {
+                function(0u, count);
+            }
+            return;
+        }
+        std::atomic<uint32_t> counter(num_jobs);
+        for (uint32_t job_i = 0; job_i < num_jobs; ++job_i)
+        {
+            job_t job = { };
+            job.function = &invoke<function_t>;
+            job.data = (void*)&function;
+            job.begin = job_i * grain_size;
+            job.end = minimum<uint32_t>(count, job.begin + grain_size);
+            job.counter = &counter;
+            submit(job, owner(job.begin));
+        }
+        wait(counter);
+    }
+
+private:
+    template<typename function_t>
+    static void invoke(void* data, uint32_t begin, uint32_t end)
+    {
+        (*(const function_t*)data)(begin, end);
+    }
+
+    struct job_deque_t
+    {
+        std::mutex              mutex;
+        std::deque<job_t>       jobs;
+        // Number of pinned jobs queued, only the owner of the deque can run them.
+        std::atomic<uint32_t>   num_pinned{ 0 };
+    };
+
+    // Pop a job from the thread's own deque, or steal one from another. Returns false if there was nothing to run.
+    bool try_run_job(uint32_t thread_index);
+    void worker_main(uint32_t thread_index);
+
+    std::unique_ptr<job_deque_t[]>  m_deques;
+    std::vector<std::thread>        m_workers;
+    // CPU each worker is pinned to, empty if they aren't.
+    std::vector<uint32_t>           m_worker_cpus;
+    bool                            m_row_owners = false;
+    // Number of queued jobs any thread may run. Idle workers sleep while there are none, and none are pinned to them.
+    std::atomic<uint32_t>           m_num_stealable{ 0 };
+    std::atomic<bool>               m_exit{ false };
+    std::mutex                      m_sleep_mutex;
+    std::condition_variable         m_wake;
+};
+} // swrast
@@ -45,6 +45,7 @@ public:
            free((void*)m_base_address);
         } 
         m_base_address = 0ULL;
+        m_size_bytes = 0ULL;
         return result_ok;
     }
 
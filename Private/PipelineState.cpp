@@ -0,0 +1,235 @@
+//
+#include "PipelineState.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace swrast {
+
+
+static pipeline_cache_t pipeline_cache;
+
+
+// FNV-1a, over the bytes of a value. Only used on values without padding.
+template<typename type>
+static uint64_t hash_value(uint64_t hash, const type& value)
+{
+    const uint8_t* bytes = (const uint8_t*)&value;
+    for (size_t i = 0; i < sizeof(type); ++i)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+static const uint64_t hash_seed = 0xcbf29ce484222325ULL;
+
+
+static uint64_t hash_pipeline_state_desc(const pipeline_state_desc_t& desc)
+{
+    uint64_t hash = hash_seed;
+    hash = hash_value(hash, desc.vertex_shader);
+    hash = hash_value(hash, desc.pixel_shader);
+    hash = hash_value(hash, desc.input_layout);
+    hash = hash_value(hash, desc.primitive_topology);
+    hash = hash_value(hash, desc.primitive_restart_enable);
+    hash = hash_value(hash, desc.cull_mode);
+    hash = hash_value(hash, desc.front_face);
+    hash = hash_value(hash, desc.line_width);
+    hash = hash_value(hash, desc.point_size);
+    hash = hash_value(hash, desc.depth_enable);
+    hash = hash_value(hash, desc.depth_write_enable);
+    hash = hash_value(hash, desc.depth_compare);
+    return hash;
+}
+
+
+static bool same_pipeline_state_desc(const pipeline_state_desc_t& a, const pipeline_state_desc_t& b)
+{
+    return a.vertex_shader == b.vertex_shader &&
+        a.pixel_shader == b.pixel_shader &&
+        a.input_layout == b.input_layout &&
+        a.primitive_topology == b.primitive_topology &&
+        a.primitive_restart_enable == b.primitive_restart_enable &&
+        a.cull_mode == b.cull_mode &&
+        a.front_face == b.front_face &&
+        a.line_width == b.line_width &&
+        a.point_size == b.point_size &&
+        a.depth_enable == b.depth_enable &&
+        a.depth_write_enable == b.depth_write_enable &&
+        a.depth_compare == b.depth_compare;
+}
+
+
+static bool is_valid_topology(primitive_topology_t primitive_topology)
+{
+    switch (primitive_topology)
+    {
+        case primitive_topology_trianglelist:
+        case primitive_topology_trianglestrip:
+        case primitive_topology_trianglefan:
+        case primitive_topology_points:
+        case primitive_topology_lines:
+        case primitive_topology_linestrip:
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+
+template<typename type>
+static void erase_entry(std::unordered_map<uint64_t, std::vector<type*>>& entries, type* entry)
+{
+    std::vector<type*>& bucket = entries[entry->hash];
+    bucket.erase(std::find(bucket.begin(), bucket.end(), entry));
+    if (bucket.empty())
+    {
+        entries.erase(entry->hash);
+    }
+}
+
+
+input_layout_t pipeline_cache_t::create_input_layout(uint32_t num_elements, const input_element_desc* descs)
+{
+    if (num_elements > SWRAST_MAX_INPUT_ELEMENTS)
+    {
+        return 0;
+    }
+    uint64_t hash = hash_value(hash_seed, num_elements);
+    for (uint32_t i = 0; i < num_elements; ++i)
+    {
+        hash = hash_value(hash, descs[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (cached_input_layout_t* entry : m_input_layouts[hash])
+    {
+        if (entry->num_elements == num_elements && memcmp(entry->descs, descs, num_elements * sizeof(input_element_desc)) == 0)
+        {
+            ++entry->references;
+            return (input_layout_t)&entry->layout;
+        }
+    }
+    cached_input_layout_t* entry = new cached_input_layout_t();
+    if (input_assembler_t::build_input_layout(num_elements, descs, entry->layout) != result_ok)
+    {
+        delete entry;
+        return 0;
+    }
+    entry->hash = hash;
+    entry->references = 1;
+    entry->num_elements = num_elements;
+    memcpy(entry->descs, descs, num_elements * sizeof(input_element_desc));
+    m_input_layouts[hash].push_back(entry);
+    return (input_layout_t)&entry->layout;
+}
+
+
+void pipeline_cache_t::release_input_layout(cached_input_layout_t* entry)
+{
+    if (--entry->references == 0)
+    {
+        erase_entry(m_input_layouts, entry);
+        delete entry;
+    }
+}
+
+
+error_t pipeline_cache_t::destroy_input_layout(input_layout_t layout)
+{
+    if (!layout)
+    {
+        return result_failed;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    release_input_layout((cached_input_layout_t*)layout);
+    return result_ok;
+}
+
+
+pipeline_state_t pipeline_cache_t::create_pipeline_state(const pipeline_state_desc_t& desc)
+{
+    if (!desc.vertex_shader || !desc.pixel_shader || !desc.input_layout || !is_valid_topology(desc.primitive_topology) ||
+        desc.pixel_shader->get_varying_stride_bytes() > SWRAST_MAX_VARYING_SIZE_BYTES)
+    {
+        return 0;
+    }
+    const uint64_t hash = hash_pipeline_state_desc(desc);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (pipeline_state_object_t* entry : m_pipeline_states[hash])
+    {
+        if (same_pipeline_state_desc(entry->desc, desc))
+        {
+            ++entry->references;
+            return (pipeline_state_t)entry;
+        }
+    }
+    pipeline_state_object_t* entry = new pipeline_state_object_t();
+    entry->desc = desc;
+    entry->hash = hash;
+    entry->references = 1;
+    // The pipeline state keeps its input layout alive.
+    cached_input_layout_t* layout = (cached_input_layout_t*)desc.input_layout;
+    ++layout->references;
+    entry->layout = &layout->layout;
+
+    raster_state_t& raster_state = entry->raster_state;
+    raster_state.pixel_shader = desc.pixel_shader;
+    raster_state.cull_mode = desc.cull_mode;
+    raster_state.depth_compare = desc.depth_compare;
+    raster_state.depth_enabled = desc.depth_enable;
+    raster_state.depth_write_enabled = desc.depth_write_enable;
+    raster_state.line_width = desc.line_width;
+    raster_state.point_size = desc.point_size;
+    raster_state.fragment_kernel = rasterizer_t::select_fragment_kernel(desc.depth_enable, desc.depth_compare, desc.depth_write_enable);
+    raster_state.interpolator.build(*desc.pixel_shader);
+    m_pipeline_states[hash].push_back(entry);
+    return (pipeline_state_t)entry;
+}
+
+
+error_t pipeline_cache_t::destroy_pipeline_state(pipeline_state_t pipeline_state)
+{
+    pipeline_state_object_t* entry = (pipeline_state_object_t*)pipeline_state;
+    if (!entry)
+    {
+        return result_failed;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (--entry->references == 0)
+    {
+        erase_entry(m_pipeline_states, entry);
+        release_input_layout((cached_input_layout_t*)entry->layout);
+        delete entry;
+    }
+    return result_ok;
+}
+
+
+input_layout_t create_input_layout(uint32_t num_elements, input_element_desc* descs)
+{
+    return pipeline_cache.create_input_layout(num_elements, descs);
+}
+
+
+error_t destroy_input_layout(input_layout_t layout)
+{
+    return pipeline_cache.destroy_input_layout(layout);
+}
+
+
+pipeline_state_t create_pipeline_state(const pipeline_state_desc_t& desc)
+{
+    return pipeline_cache.create_pipeline_state(desc);
+}
+
+
+error_t destroy_pipeline_state(pipeline_state_t pipeline_state)
+{
+    return pipeline_cache.destroy_pipeline_state(pipeline_state);
+}
+} // swrast
@@ -0,0 +1,56 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "InputAssembly.hpp"
+#include "Rasterizer.hpp"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace swrast {
+
+
+// Input layout handed out by the pipeline cache. The layout comes first, so handles point at both.
+struct cached_input_layout_t
+{
+    input_layout        layout;
+    uint64_t            hash;
+    uint32_t            references;
+    uint32_t            num_elements;
+    input_element_desc  descs[SWRAST_MAX_INPUT_ELEMENTS];
+};
+
+
+// Immutable pipeline state. Everything that does not change between draws is validated, and derived,
+// once at creation, so binding it is a handful of copies.
+struct pipeline_state_object_t
+{
+    pipeline_state_desc_t   desc;
+    uint64_t                hash;
+    uint32_t                references;
+    input_layout*           layout;
+    raster_state_t          raster_state;
+};
+
+
+// Deduplicates input layouts and pipeline states, keyed by a hash of their description. Creating one that
+// matches an existing entry returns the existing entry, with one more reference. Entries are freed once
+// every reference is destroyed. Shared by every context.
+class pipeline_cache_t
+{
+public:
+    input_layout_t create_input_layout(uint32_t num_elements, const input_element_desc* descs);
+    error_t destroy_input_layout(input_layout_t layout);
+    pipeline_state_t create_pipeline_state(const pipeline_state_desc_t& desc);
+    error_t destroy_pipeline_state(pipeline_state_t pipeline_state);
+
+private:
+    void release_input_layout(cached_input_layout_t* entry);
+
+    std::mutex                                                              m_mutex;
+    std::unordered_map<uint64_t, std::vector<cached_input_layout_t*>>       m_input_layouts;
+    std::unordered_map<uint64_t, std::vector<pipeline_state_object_t*>>     m_pipeline_states;
+};
+} // swrast
@@ -0,0 +1,218 @@
+//
+#include "PointSplat.hpp"
+#include "HardwareShader.hpp"
+
+#include <cstring>
+
+namespace swrast {
+
+
+// Empty splat, any point will win against it.
+#define SWRAST_SPLAT_EMPTY 0xFFFFFFFFFFFFFFFFull
+
+// Amount of work, given to a single job.
+#define SWRAST_SPLAT_POINTS_PER_JOB 16384
+#define SWRAST_SPLAT_ROWS_PER_JOB 32
+
+
+// Remaps float bits, so that unsigned integer ordering matches the float ordering.
+static uint32_t orderable_depth_bits(float depth)
+{
+    uint32_t bits = 0;
+    memcpy(&bits, &depth, sizeof(float));
+    return (bits & 0x80000000) ? ~bits : (bits | 0x80000000);
+}
+
+
+static float depth_from_orderable_bits(uint32_t bits)
+{
+    bits = (bits & 0x80000000) ? (bits & 0x7FFFFFFF) : ~bits;
+    float depth = 0.f;
+    memcpy(&depth, &bits, sizeof(float));
+    return depth;
+}
+
+
+// The atomic min acts as the depth test, so compare ops that favor the larger depth flip the key.
+static bool is_reversed_depth(compare_op_t op)
+{
+    return (op == compare_op_greater) || (op == compare_op_greater_equal);
+}
+
+
+static void atomic_min(std::atomic<uint64_t>& target, uint64_t value)
+{
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+error_t point_splatter_t::release()
+{
+    splat_buffer.reset();
+    splat_buffer_size = 0;
+    return result_ok;
+}
+
+
+void point_splatter_t::prepare_splat_buffer(uint32_t width, uint32_t height)
+{
+    const uint64_t size = (uint64_t)width * height;
+    if (size > splat_buffer_size)
+    {
+        splat_buffer.reset(new std::atomic<uint64_t>[size]);
+        splat_buffer_size = size;
+    }
+    splat_buffer_width = width;
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        splat_buffer[i].store(SWRAST_SPLAT_EMPTY, std::memory_order_relaxed);
+    }
+}
+
+
+void point_splatter_t::splat_range(const point_splat_desc_t& desc, const viewport_t& viewport, compare_op_t compare_op, uint32_t begin, uint32_t end)
+{
+    const float* m = desc.view_projection.m;
+    // Row vector transform, clip = float4_t(p, 1) * view_projection
+    const __m128 m0  = _mm_set1_ps(m[0]),  m1  = _mm_set1_ps(m[1]),  m2  = _mm_set1_ps(m[2]),  m3  = _mm_set1_ps(m[3]);
+    const __m128 m4  = _mm_set1_ps(m[4]),  m5  = _mm_set1_ps(m[5]),  m6  = _mm_set1_ps(m[6]),  m7  = _mm_set1_ps(m[7]);
+    const __m128 m8  = _mm_set1_ps(m[8]),  m9  = _mm_set1_ps(m[9]),  m10 = _mm_set1_ps(m[10]), m11 = _mm_set1_ps(m[11]);
+    const __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]), m15 = _mm_set1_ps(m[15]);
+
+    // Viewport transform, same as the rasterizer.
+    const float half_width = (float)viewport.width * 0.5f;
+    const float half_height = (float)viewport.height * 0.5f;
+    const __m128 scale_x = _mm_set1_ps(half_width);
+    const __m128 scale_y = _mm_set1_ps(half_height);
+    const __m128 bias_x = _mm_set1_ps((float)viewport.x + half_width);
+    const __m128 bias_y = _mm_set1_ps((float)viewport.y + half_height);
+    const __m128 scale_z = _mm_set1_ps((viewport.far - viewport.near) * 0.5f);
+    const __m128 bias_z = _mm_set1_ps((viewport.far + viewport.near) * 0.5f);
+    const __m128 one = _mm_set1_ps(1.f);
+
+    const bool reversed = is_reversed_depth(compare_op);
+    const int32_t min_x = (int32_t)viewport.x;
+    const int32_t min_y = (int32_t)viewport.y;
+    const int32_t max_x = (int32_t)(viewport.x + viewport.width);
+    const int32_t max_y = (int32_t)(viewport.y + viewport.height);
+
+    for (uint32_t point = begin; point < end; point += 4)
+    {
+        // Gather 4 points. The tail repeats the last point, which is discarded below.
+        const uint32_t lanes = minimum<uint32_t>(4u, end - point);
+        const float3_t* p[4];
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            const uint32_t point_id = desc.first_point + point + minimum<uint32_t>(lane, lanes - 1);
+            p[lane] = (const float3_t*)(desc.positions + (uintptr_t)point_id * desc.position_stride_bytes);
+        }
+        const __m128 x = _mm_setr_ps(p[0]->x, p[1]->x, p[2]->x, p[3]->x);
+        const __m128 y = _mm_setr_ps(p[0]->y, p[1]->y, p[2]->y, p[3]->y);
+        const __m128 z = _mm_setr_ps(p[0]->z, p[1]->z, p[2]->z, p[3]->z);
+
+        const __m128 clip_x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m0), _mm_mul_ps(y, m4)), _mm_add_ps(_mm_mul_ps(z, m8),  m12));
+        const __m128 clip_y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m1), _mm_mul_ps(y, m5)), _mm_add_ps(_mm_mul_ps(z, m9),  m13));
+        const __m128 clip_z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m2), _mm_mul_ps(y, m6)), _mm_add_ps(_mm_mul_ps(z, m10), m14));
+        const __m128 clip_w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m3), _mm_mul_ps(y, m7)), _mm_add_ps(_mm_mul_ps(z, m11), m15));
+
+        // Project to ndc, then to raster space.
+        const __m128 w_inv = _mm_div_ps(one, clip_w);
+        alignas(16) float screen_x[4];
+        alignas(16) float screen_y[4];
+        alignas(16) float screen_z[4];
+        alignas(16) float w[4];
+        _mm_store_ps(screen_x, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip_x, w_inv), scale_x), bias_x));
+        _mm_store_ps(screen_y, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip_y, w_inv), scale_y), bias_y));
+        _mm_store_ps(screen_z, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip_z, w_inv), scale_z), bias_z));
+        _mm_store_ps(w, clip_w);
+
+        for (uint32_t lane = 0; lane < lanes; ++lane)
+        {
+            // Behind the camera.
+            if (w[lane] <= 0.f)
+            {
+                continue;
+            }
+            const int32_t x_s = (int32_t)floorf(screen_x[lane]);
+            const int32_t y_s = (int32_t)floorf(screen_y[lane]);
+            if (x_s < min_x || x_s >= max_x || y_s < min_y || y_s >= max_y)
+            {
+                continue;
+            }
+            // Same depth as the triangle path.
+            const float depth = 1.f / screen_z[lane];
+            const uint32_t point_id = desc.first_point + point + lane;
+            const uint32_t color = desc.colors 
+                ? *(const uint32_t*)(desc.colors + (uintptr_t)point_id * desc.color_stride_bytes) 
+                : 0xFFFFFFFF;
+            uint32_t key = orderable_depth_bits(depth);
+            key = reversed ? ~key : key;
+            const uint64_t splat = ((uint64_t)key << 32) | color;
+            atomic_min(splat_buffer[(uint64_t)(y_s - min_y) * splat_buffer_width + (x_s - min_x)], splat);
+        }
+    }
+}
+
+
+void point_splatter_t::resolve_rows(rasterizer_t& rasterizer, const viewport_t& viewport, uint32_t begin_row, uint32_t end_row)
+{
+    render_output_t& rop = rasterizer.get_rop();
+    framebuffer_t& framebuffer = rasterizer.get_frame_buffer();
+    const compare_op_t compare_op = rasterizer.get_depth_compare_op();
+    const bool reversed = is_reversed_depth(compare_op);
+    const bool depth_enabled = rasterizer.is_depth_enabled();
+    // Like triangles, depth is only written with the depth test on.
+    const bool depth_write_enabled = depth_enabled && rasterizer.is_depth_write_enabled();
+    for (uint32_t row = begin_row; row < end_row; ++row)
+    {
+        for (uint32_t column = 0; column < viewport.width; ++column)
+        {
+            const uint64_t splat = splat_buffer[(uint64_t)row * splat_buffer_width + column].load(std::memory_order_relaxed);
+            if (splat == SWRAST_SPLAT_EMPTY)
+            {
+                continue;
+            }
+            const uint32_t x_s = viewport.x + column;
+            const uint32_t y_s = viewport.y + row;
+            const uint32_t key = (uint32_t)(splat >> 32);
+            const float depth = depth_from_orderable_bits(reversed ? ~key : key);
+            if (depth_enabled)
+            {
+                float dest_value = rop.read_depth_stencil(framebuffer, 0, x_s, y_s);
+                if (!is_pass_depth_test(compare_op, dest_value, depth))
+                {
+                    continue;
+                }
+            }
+            rop.shade_to_output(framebuffer, 0, 0, x_s, y_s, rgba8_to_norm((uint32_t)splat));
+            if (depth_write_enabled)
+            {
+                rop.write_to_depth_stencil(framebuffer, 0, x_s, y_s, depth);
+            }
+        }
+    }
+}
+
+
+error_t point_splatter_t::splat(const point_splat_desc_t& desc, rasterizer_t& rasterizer)
+{
+    if (!desc.positions)
+    {
+        return result_failed;
+    }
+    const viewport_t viewport = rasterizer.get_viewport(0);
+    const compare_op_t compare_op = rasterizer.get_depth_compare_op();
+    prepare_splat_buffer(viewport.width, viewport.height);
+
+    m_job_system->parallel_for(desc.num_points, SWRAST_SPLAT_POINTS_PER_JOB, 
+        [&] (uint32_t begin, uint32_t end) { splat_range(desc, viewport, compare_op, begin, end); });
+
+    // Every pixel is owned by one row, so the resolve needs no synchronization.
+    m_job_system->parallel_for(viewport.height, SWRAST_SPLAT_ROWS_PER_JOB, 
+        [&] (uint32_t begin, uint32_t end) { resolve_rows(rasterizer, viewport, begin, end); });
+    return result_ok;
+}
+} // swrast
@@ -0,0 +1,41 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "Rasterizer.hpp"
+
+#include <atomic>
+#include <memory>
+
+namespace swrast {
+
+
+// Point splatter renders large point clouds, without going through the triangle pipeline. Positions are 
+// transformed 4 at a time with SIMD, projected, and resolved per pixel with a 64 bit atomic min on a packed
+// depth (upper 32 bits) and color (lower 32 bits). Since the depth is in the upper bits, the closest point 
+// always wins, no matter which thread writes it first. Splats are then resolved into the framebuffer.
+class point_splatter_t
+{
+public:
+    error_t initialize(job_system_t* job_system) { m_job_system = job_system; return result_ok; }
+    error_t release();
+
+    // Splat the points into the rasterizer's bound framebuffer, with its first viewport and depth state.
+    error_t splat(const point_splat_desc_t& desc, rasterizer_t& rasterizer);
+
+private:
+    // Transform and splat a range of points into the splat buffer.
+    void splat_range(const point_splat_desc_t& desc, const viewport_t& viewport, compare_op_t compare_op, uint32_t begin, uint32_t end);
+
+    // Resolve a range of rows of the splat buffer into the framebuffer.
+    void resolve_rows(rasterizer_t& rasterizer, const viewport_t& viewport, uint32_t begin_row, uint32_t end_row);
+
+    // Makes sure the splat buffer can hold the viewport, and clears it.
+    void prepare_splat_buffer(uint32_t width, uint32_t height);
+
+    std::unique_ptr<std::atomic<uint64_t>[]> splat_buffer;
+    uint64_t splat_buffer_size = 0;
+    uint32_t splat_buffer_width = 0;
+    job_system_t* m_job_system = nullptr;
+};
+} // swrast
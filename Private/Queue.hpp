@@ -0,0 +1,72 @@
+//
+#pragma once
+
+#include "Context.hpp"
+
+#include <atomic>
+#include <thread>
+
+namespace swrast {
+
+
+// Lock free, bounded, single producer single consumer ring queue. Capacity must be a power of 2. 
+// The producer only ever writes the tail, and the consumer only ever writes the head, so each side 
+// just needs to publish its index with release semantics, and observe the other's with acquire.
+template<typename type, uint32_t capacity>
+class spsc_queue_t
+{
+public:
+    static_assert((capacity & (capacity - 1)) == 0, "Queue capacity must be a power of 2.");
+
+    // Producer side. Returns false if the queue is full.
+    bool push(const type& value)
+    {
+        const uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == capacity)
+        {
+            return false;
+        }
+        m_items[tail & (capacity - 1)] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool pop(type& out_value)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        out_value = m_items[head & (capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Blocking versions, which yield while waiting on the other side.
+    void push_wait(const type& value)
+    {
+        while (!push(value))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    type pop_wait()
+    {
+        type value;
+        while (!pop(value))
+        {
+            std::this_thread::yield();
+        }
+        return value;
+    }
+
+private:
+    // Head and tail live on separate cache lines, so the producer and consumer don't false share.
+    alignas(64) std::atomic<uint32_t> m_head{ 0 };
+    alignas(64) std::atomic<uint32_t> m_tail{ 0 };
+    type m_items[capacity];
+};
+} // swrast
@@ -1,5 +1,7 @@
 //
 #include "Rasterizer.hpp"
+#include "Visibility.hpp"
+#include <cfloat>
 
 namespace swrast {
 
@@ -39,6 +41,22 @@ bool is_pass_depth_test(compare_op_t op, float dest_depth, float source_depth)
 }
 
 
+// Number of array slices a surface holds. Only array resources have more than one.
+static uint32_t surface_array_size(const resource_desc_t& desc)
+{
+    switch (desc.type)
+    {
+        case resource_type_texture1darray:
+        case resource_type_texture2darray:
+        case resource_type_texturecube:
+            return desc.depth_or_array_size;
+        default:
+            break;
+    }
+    return 1;
+}
+
+
 float4_t rasterizer_t::clip_to_ndc(float4_t clip)
 {    
     // Perspective division is done in order to project to ndc space.
@@ -48,14 +66,14 @@ float4_t rasterizer_t::clip_to_ndc(float4_t clip)
 }
 
 
-float4_t rasterizer_t::ndc_to_screen(float4_t ndc_coord)
+float4_t rasterizer_t::ndc_to_screen(float4_t ndc_coord, const viewport_t& viewport)
 {
-    const float width   = (float)m_viewports[0].width;
-    const float height  = (float)m_viewports[0].height;
-    const float x       = (float)m_viewports[0].x;
-    const float y       = (float)m_viewports[0].y;
-    const float f       = m_viewports[0].far;
-    const float n       = m_viewports[0].near;
+    const float width   = (float)viewport.width;
+    const float height  = (float)viewport.height;
+    const float x       = (float)viewport.x;
+    const float y       = (float)viewport.y;
+    const float f       = viewport.far;
+    const float n       = viewport.near;
     // Relies on viewport transformation, in order to project our normalized device coordinates
     // to screen coordinates.
     return float4_t
@@ -67,6 +85,12 @@ float4_t rasterizer_t::ndc_to_screen(float4_t ndc_coord)
         );
 }
 
+
+uint32_t rasterizer_t::read_vertex_system_value(uintptr_t vertex, uint32_t offset)
+{
+    return (offset != SWRAST_INVALID_OFFSET) ? *(uint32_t*)(vertex + offset) : 0;
+}
+
 static void calculate_winding_order(cull_mode_t cull_mode, front_face_t& out_face, float& out_area)
 {
     // Negative area is flipped.
@@ -100,212 +124,793 @@ static void calculate_winding_order(cull_mode_t cull_mode, front_face_t& out_fac
 }
 
 
-error_t rasterizer_t::raster(uint32_t num_triangles, vertices_t& vertices, front_face_t winding_order)
+const interpolator_layout_t& rasterizer_t::get_interpolator()
 {
-    const bool depth_enabled = m_depth_enabled;
-    const bool depth_write_enabled = depth_enabled && m_depth_write_enabled;
+    if (m_interpolator_dirty && m_bound_pixel_shader)
+    {
+        m_interpolator.build(*m_bound_pixel_shader);
+        m_interpolator_dirty = false;
+    }
+    return m_interpolator;
+}
 
-    // Check varying allocation pool.
-    allocate_varying_heap(m_viewports[0].width * m_viewports[0].height * varying_max_size_bytes);
 
-    // Convert our triangle from clip space to ndc space.
-    for (uint32_t tri_id = 0; tri_id < num_triangles; ++tri_id)
-    {
-        float4_t& v0 = vertices.get_vertex_position(tri_id * 3 + 0);
-        float4_t& v1 = vertices.get_vertex_position(tri_id * 3 + 1);
-        float4_t& v2 = vertices.get_vertex_position(tri_id * 3 + 2);
-        v0 = clip_to_ndc(v0);
-        v1 = clip_to_ndc(v1);
-        v2 = clip_to_ndc(v2);
+error_t rasterizer_t::raster(uint32_t num_primitives, uint32_t vertices_per_primitive, vertices_t& vertices, front_face_t winding_order)
+{
+    get_interpolator();
 
-        // From ndc space, we project to raster space (screen space.)
-        // our w is left as is (1 / w)
-        v0 = ndc_to_screen(v0);
-        v1 = ndc_to_screen(v1);
-        v2 = ndc_to_screen(v2);
+    // One varying struct for each thread that may shade fragments.
+    const uint64_t varying_scratch_size = varying_max_size_bytes * m_job_system->get_num_thread_indices();
+    if (varying_scratch_size > m_varying_scratch.get_memory_size_bytes())
+    {
+        m_varying_scratch.preallocate(varying_scratch_size);
     }
 
-    // NDC triangles convert to raster space, and are rasterized!
-    for (uint32_t tri_id = 0; tri_id < num_triangles; ++tri_id)
+    // Tile grid, covering every viewport.
+    uint32_t max_x = 0;
+    uint32_t max_y = 0;
+    for (uint32_t i = 0; i < m_num_viewports; ++i)
     {
-        // Triangles should be in raster space. (except 1 / w)
-        float4_t v0_s = vertices.get_vertex_position(tri_id * 3 + 0);
-        float4_t v1_s = vertices.get_vertex_position(tri_id * 3 + 1);
-        float4_t v2_s = vertices.get_vertex_position(tri_id * 3 + 2);
-
-        float area = winding_order == front_face_clockwise 
-                                        ? edge_function(v0_s, v2_s, v1_s) 
-                                        : edge_function(v0_s, v1_s, v2_s);
-        front_face_t current_order = winding_order; 
-        
-        // Manage the winding order, which affects the area of the triangle.
-        calculate_winding_order(cull_mode, current_order, area);
+        max_x = maximum<uint32_t>(max_x, (uint32_t)(m_viewports[i].x + m_viewports[i].width));
+        max_y = maximum<uint32_t>(max_y, (uint32_t)(m_viewports[i].y + m_viewports[i].height));
+    }
+    m_tiles_x = (max_x + SWRAST_TILE_SIZE - 1) / SWRAST_TILE_SIZE;
+    m_tiles_y = (max_y + SWRAST_TILE_SIZE - 1) / SWRAST_TILE_SIZE;
+    if (m_bins.size() < (size_t)m_tiles_x * m_tiles_y)
+    {
+        m_bins.resize((size_t)m_tiles_x * m_tiles_y);
+    }
 
-        // Cull if area is negative.
-        if (area < 0)
-            continue;
+    // Multi-view fans out every primitive to each view, only if the vertex shader provided the per view positions.
+    const bool multi_view = (m_view_count > 1) && (vertices.view_pos_offset != SWRAST_INVALID_OFFSET);
+    const uint32_t view_count = multi_view ? m_view_count : 1;
+    // Slices every bound target has, primitives routed past them are dropped.
+    const uint32_t array_size = get_framebuffer_array_size();
 
-        // We use raster space to calculate the bounding box of the 
-        // triangle on screen, to which here we then perform the actual rasterization.
-        ibounds2d_t bounds = calculate_bounding_volume2d(v0_s, v1_s, v2_s);
+    // Visibility passes keep the shaded vertices until they are resolved. Triangles point at the copy.
+    uintptr_t vertices_copy = 0;
+    m_raster_kernel = m_fragment_kernel;
+    if (m_visibility_buffer)
+    {
+        resource_t target = m_bound_framebuffer.num_render_targets ? m_bound_framebuffer.bound_render_targets[0] : m_bound_framebuffer.bound_depth_stencil;
+        if (!target)
+        {
+            return result_ok;
+        }
+        const resource_desc_t* desc = (const resource_desc_t*)(target - sizeof(resource_desc_t));
+        m_visibility_buffer->prepare(desc->width, desc->height, surface_array_size(*desc));
+        if (!m_visibility_buffer->reserve_triangles(num_primitives * view_count))
+        {
+            resolve_visibility();
+            m_visibility_buffer->restart_draw();
+        }
+        vertices_copy = m_visibility_buffer->copy(vertices.vertices_base, (uint64_t)vertices.num_vertices * vertices.vertex_stride);
+        m_raster_kernel = select_fragment_kernel(m_depth_enabled, depth_compare, m_depth_write_enabled, true);
+    }
 
-        // This is not the most optimal way to rasterize a triangle, but it beats
-        // traversing the entire framebuffer, in order to check for shaded fragments 
-        // that are covered.
-        for (int32_t y_s = bounds.minima.y; y_s < bounds.maxima.y; ++y_s)
+    m_primitives.clear();
+    m_active_tiles.clear();
+    uint32_t num_binned = 0;
+    for (uint32_t view_id = 0; view_id < view_count; ++view_id)
+    {
+        const uint32_t pos_offset = multi_view ? vertices.view_pos_offset + view_id * sizeof(float4_t) : vertices.pos_offset;
+        for (uint32_t prim_id = 0; prim_id < num_primitives; ++prim_id)
         {
-            for (int32_t x_s = bounds.minima.x; x_s < bounds.maxima.x; ++x_s)
+            binned_primitive_t primitive = { };
+            for (uint32_t corner = 0; corner < vertices_per_primitive; ++corner)
             {
-                float2_t p = { (float)x_s + 0.5f, (float)y_s + 0.5f };
-                float w0 = 0.f;
-                float w1 = 0.f;
-                float w2 = 0.f;
-                switch (current_order)
-                {
-                    case front_face_counter_clockwise:                
-                    {
-                        w0 = edge_function(v1_s, v2_s, p); 
-                        w1 = edge_function(v2_s, v0_s, p);
-                        w2 = edge_function(v0_s, v1_s, p);
-                        break;
-                   }
-                    case front_face_clockwise:
-                    {
-                        w0 = edge_function(v2_s, v1_s, p); 
-                        w1 = edge_function(v0_s, v2_s, p);
-                        w2 = edge_function(v1_s, v0_s, p);
-                        break;
-                    }
-                }
-                // rasterize!
-                if (w0 >= 0 && w1 >= 0 && w2 >= 0)
-                {
-                    // Barycentric coordinates are calculated
-                    w0 /= area;
-                    w1 /= area;
-                    w2 /= area;
-
-                    // linearly interpolate z and w
-                    float w_inv = 1.f / (w0 * v0_s.w + w1 * v1_s.w + w2 * v2_s.w);
-                    float z = 1.f / (v0_s.z * w0 + v1_s.z * w1 + v2_s.z * w2);
-                    if (m_depth_enabled)
-                    {
-                        float dest_value = rop.read_depth_stencil(m_bound_framebuffer, m_viewports[0], x_s, y_s);
-                        if (!is_pass_depth_test(depth_compare, dest_value, z))
-                        {
-                            // Failed depth test, don't write to pixel.
-                            continue;
-                        }
-                    }
+                primitive.attribs[corner] = vertices.get_primitive_vertex(prim_id * vertices_per_primitive + corner);
+            }
+
+            // Route the primitive to the viewport, and render target slice. With multi-view, the view decides,
+            // otherwise the provoking vertex does. Out of range viewports will fall back to the first one.
+            if (multi_view)
+            {
+                primitive.viewport_index = m_view_locations[view_id].viewport_array_index;
+                primitive.array_index = m_view_locations[view_id].render_target_array_index;
+            }
+            else
+            {
+                primitive.viewport_index = read_vertex_system_value(primitive.attribs[0], vertices.viewport_index_offset);
+                primitive.array_index = read_vertex_system_value(primitive.attribs[0], vertices.render_target_array_index_offset);
+            }
+            if (primitive.viewport_index >= m_num_viewports)
+            {
+                primitive.viewport_index = 0;
+            }
+            if (primitive.array_index >= array_size)
+            {
+                continue;
+            }
+            const viewport_t& viewport = m_viewports[primitive.viewport_index];
+            for (uint32_t corner = 0; corner < vertices_per_primitive; ++corner)
+            {
+                primitive.screen_positions[corner] = ndc_to_screen(clip_to_ndc(*(float4_t*)(primitive.attribs[corner] + pos_offset)), viewport);
+            }
 
-                    // Perspective correction on our barycentrics.
-                    float3_t persp_b = float3_t
-                        (
-                            w_inv * v0_s.w * w0, 
-                            w_inv * v1_s.w * w1, 
-                            w_inv * v2_s.w * w2
-                        );
-
-                    uintptr_t attrib_v0 = vertices.get_vertex(tri_id * 3 + 0);
-                    uintptr_t attrib_v1 = vertices.get_vertex(tri_id * 3 + 1);
-                    uintptr_t attrib_v2 = vertices.get_vertex(tri_id * 3 + 2);
-
-                    // 
-                    uintptr_t varying_address = allocate_varying();
-
-                    m_bound_pixel_shader->interpolate_varying(varying_address, attrib_v0, attrib_v1, attrib_v2, persp_b);
-                    
-                    // execute the bound pixel shader. This should probably be optimized!
-                    float4_t output = m_bound_pixel_shader ? m_bound_pixel_shader->execute(varying_address) : float4_t(0, 0, 0, 0);
-
-                    // Finally, store the shaded pixel into the framebuffer.
-                    rop.shade_to_output(m_bound_framebuffer, 0, m_viewports[0], x_s, y_s, output);
-                    if (m_depth_write_enabled)
+            // Bin the primitive into every tile its bounds overlap. Primitives are binned in order, 
+            // so each tile sees them in submission order.
+            const ibounds2d_t bounds = primitive_bounds(primitive, vertices_per_primitive);
+            if (bounds.minima.x >= bounds.maxima.x || bounds.minima.y >= bounds.maxima.y)
+            {
+                continue;
+            }
+            if (m_visibility_buffer && !record_visibility(primitive, vertices.vertices_base, vertices_copy, winding_order))
+            {
+                continue;
+            }
+            const uint32_t primitive_index = (uint32_t)m_primitives.size();
+            m_primitives.push_back(primitive);
+            for (int32_t tile_y = bounds.minima.y / SWRAST_TILE_SIZE; tile_y <= (bounds.maxima.y - 1) / SWRAST_TILE_SIZE; ++tile_y)
+            {
+                for (int32_t tile_x = bounds.minima.x / SWRAST_TILE_SIZE; tile_x <= (bounds.maxima.x - 1) / SWRAST_TILE_SIZE; ++tile_x)
+                {
+                    const uint32_t tile_index = tile_y * m_tiles_x + tile_x;
+                    std::vector<uint32_t>& bin = m_bins[tile_index];
+                    if (bin.empty())
                     {
-                        rop.write_to_depth_stencil(m_bound_framebuffer, m_viewports[0], x_s, y_s, z);
+                        m_active_tiles.push_back(tile_index);
                     }
+                    bin.push_back(primitive_index);
+                    ++num_binned;
                 }
             }
         }
     }
+
+    // Rasterize the tiles in parallel, one tile per job. Each tile goes to the worker owning its rows, if any.
+    // Small draws run as a single job, on the calling thread.
+    const uint32_t num_active_tiles = (uint32_t)m_active_tiles.size();
+    const uint32_t tiles_per_job = num_binned < SWRAST_MIN_PARALLEL_BINNED_PRIMITIVES ? num_active_tiles : 1;
+    const uint32_t target_height = get_framebuffer_height();
+    const auto tile_owner = [&] (uint32_t begin)
+    {
+        return m_job_system->get_row_owner((m_active_tiles[begin] / m_tiles_x) * SWRAST_TILE_SIZE, target_height);
+    };
+    m_job_system->parallel_for_owned(num_active_tiles, tiles_per_job, tile_owner, [&] (uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            raster_tile(m_active_tiles[i], vertices_per_primitive, winding_order);
+        }
+    });
+
+    for (uint32_t tile_index : m_active_tiles)
+    {
+        m_bins[tile_index].clear();
+    }
     return result_ok;
 }
 
 
+void rasterizer_t::resolve_visibility()
+{
+    const visibility_buffer_t& visibility = *m_visibility_buffer;
+    const uint32_t num_draws = visibility.get_num_draws();
+    if (!num_draws)
+    {
+        return;
+    }
+    const uint32_t* ids = visibility.get_ids();
+    const uint32_t width = visibility.get_width();
+    const uint32_t height = visibility.get_height();
+    const uint32_t num_rows = height * visibility.get_array_size();
+
+    // Sort the visible pixels by draw, so each pixel shader runs with the bindings of its draw. Each job counts the 
+    // pixels of every draw in its rows, then scatters them into the range of its draw.
+    const uint32_t rows_per_job = SWRAST_CLEAR_ROWS_PER_JOB;
+    const uint32_t num_jobs = (num_rows + rows_per_job - 1) / rows_per_job;
+    m_draw_pixel_counts.assign((size_t)num_jobs * num_draws, 0);
+    m_job_system->parallel_for(num_rows, rows_per_job, [&] (uint32_t begin, uint32_t end)
+    {
+        uint32_t* counts = &m_draw_pixel_counts[(size_t)(begin / rows_per_job) * num_draws];
+        for (uint32_t pixel = begin * width; pixel < end * width; ++pixel)
+        {
+            if (ids[pixel] != SWRAST_VISIBILITY_EMPTY)
+            {
+                ++counts[ids[pixel] >> SWRAST_VISIBILITY_TRIANGLE_BITS];
+            }
+        }
+    });
+    uint32_t num_visible = 0;
+    for (uint32_t draw_id = 0; draw_id < num_draws; ++draw_id)
+    {
+        for (uint32_t job = 0; job < num_jobs; ++job)
+        {
+            uint32_t& count = m_draw_pixel_counts[(size_t)job * num_draws + draw_id];
+            const uint32_t offset = num_visible;
+            num_visible += count;
+            count = offset;
+        }
+    }
+    if (m_visible_pixels.size() < num_visible)
+    {
+        m_visible_pixels.resize(num_visible);
+    }
+    m_job_system->parallel_for(num_rows, rows_per_job, [&] (uint32_t begin, uint32_t end)
+    {
+        uint32_t* offsets = &m_draw_pixel_counts[(size_t)(begin / rows_per_job) * num_draws];
+        for (uint32_t pixel = begin * width; pixel < end * width; ++pixel)
+        {
+            if (ids[pixel] != SWRAST_VISIBILITY_EMPTY)
+            {
+                m_visible_pixels[offsets[ids[pixel] >> SWRAST_VISIBILITY_TRIANGLE_BITS]++] = pixel;
+            }
+        }
+    });
+
+    // Shade each draw in turn. Once scattered, the offsets of the last job mark the end of each draw.
+    const uint32_t* draw_ends = &m_draw_pixel_counts[(size_t)(num_jobs - 1) * num_draws];
+    uint32_t draw_begin = 0;
+    for (uint32_t draw_id = 0; draw_id < num_draws; ++draw_id)
+    {
+        const uint32_t draw_end = draw_ends[draw_id];
+        const uint32_t* pixels = m_visible_pixels.data() + draw_begin;
+        const visibility_draw_t& draw = visibility.get_draw(draw_id);
+        if (draw.pixel_shader)
+        {
+            draw.pixel_shader->set_bindings(&draw.bindings);
+        }
+        m_job_system->parallel_for(draw_end - draw_begin, SWRAST_VISIBILITY_PIXELS_PER_JOB, [&] (uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const uint32_t pixel = pixels[i];
+                const uint32_t row = pixel / width;
+                const int32_t x_s = (int32_t)(pixel % width);
+                const int32_t y_s = (int32_t)(row % height);
+                const visibility_triangle_t& triangle = visibility.get_triangle(ids[pixel]);
+                // Same math as when rasterized, so the pixel is covered, with the same depth and barycentrics.
+                float z;
+                float w_inv;
+                float3_t persp_b;
+                triangle_fragment(triangle.screen_positions[0], triangle.screen_positions[1], triangle.screen_positions[2], 
+                    triangle.area, triangle.winding_order, x_s, y_s, z, w_inv, persp_b);
+                shade_pixel(draw.pixel_shader, draw.interpolator, x_s, y_s, z, w_inv, row / height, 
+                    triangle.attribs[0], triangle.attribs[1], triangle.attribs[2], persp_b);
+            }
+        });
+        draw_begin = draw_end;
+    }
+}
+
+
+ibounds2d_t rasterizer_t::primitive_bounds(const binned_primitive_t& primitive, uint32_t vertices_per_primitive)
+{
+    const viewport_t& viewport = m_viewports[primitive.viewport_index];
+    // Lines and points extend past their vertices. Pad them conservatively, the tiles clip them exactly.
+    float padding = 1.f;
+    if (vertices_per_primitive == 1)
+    {
+        padding += maximum<float>(1.f, m_point_size) * 0.5f;
+    }
+    else if (vertices_per_primitive == 2)
+    {
+        padding += maximum<float>(1.f, m_line_width) * 0.5f;
+    }
+    fbounds2d_t screen_bounds;
+    screen_bounds.minima = float2_t(FLT_MAX, FLT_MAX);
+    screen_bounds.maxima = float2_t(-FLT_MAX, -FLT_MAX);
+    for (uint32_t corner = 0; corner < vertices_per_primitive; ++corner)
+    {
+        const float4_t& screen = primitive.screen_positions[corner];
+        screen_bounds.minima = float2_t(minimum<float>(screen_bounds.minima.x, screen.x), minimum<float>(screen_bounds.minima.y, screen.y));
+        screen_bounds.maxima = float2_t(maximum<float>(screen_bounds.maxima.x, screen.x), maximum<float>(screen_bounds.maxima.y, screen.y));
+    }
+    ibounds2d_t bounds = { };
+    // Degenerate projections (w of 0) are not rasterized.
+    if (!(screen_bounds.minima.x <= screen_bounds.maxima.x) || !(screen_bounds.minima.y <= screen_bounds.maxima.y))
+    {
+        return bounds;
+    }
+    const float min_x = (float)viewport.x;
+    const float min_y = (float)viewport.y;
+    const float max_x = (float)(viewport.x + viewport.width);
+    const float max_y = (float)(viewport.y + viewport.height);
+    bounds.minima.x = (int32_t)clamp<float>(floorf(screen_bounds.minima.x - padding), min_x, max_x);
+    bounds.minima.y = (int32_t)clamp<float>(floorf(screen_bounds.minima.y - padding), min_y, max_y);
+    bounds.maxima.x = (int32_t)clamp<float>(ceilf(screen_bounds.maxima.x + padding), min_x, max_x);
+    bounds.maxima.y = (int32_t)clamp<float>(ceilf(screen_bounds.maxima.y + padding), min_y, max_y);
+    return bounds;
+}
+
+
+bool rasterizer_t::record_visibility(binned_primitive_t& primitive, uintptr_t vertices_base, uintptr_t vertices_copy, front_face_t winding_order)
+{
+    visibility_triangle_t triangle;
+    triangle.area = triangle_area(primitive.screen_positions, winding_order, triangle.winding_order);
+    if (triangle.area < 0)
+    {
+        return false;
+    }
+    for (uint32_t corner = 0; corner < 3; ++corner)
+    {
+        triangle.screen_positions[corner] = primitive.screen_positions[corner];
+        triangle.attribs[corner] = vertices_copy + (primitive.attribs[corner] - vertices_base);
+    }
+    primitive.visibility_id = m_visibility_buffer->add_triangle(triangle);
+    return true;
+}
+
+
+void rasterizer_t::raster_tile(uint32_t tile_index, uint32_t vertices_per_primitive, front_face_t winding_order)
+{
+    tile_t tile = { };
+    tile.tile_id = tile_index;
+    tile.x = (tile_index % m_tiles_x) * SWRAST_TILE_SIZE;
+    tile.y = (tile_index / m_tiles_x) * SWRAST_TILE_SIZE;
+    tile.width = SWRAST_TILE_SIZE;
+    tile.height = SWRAST_TILE_SIZE;
+    for (uint32_t primitive_index : m_bins[tile_index])
+    {
+        const binned_primitive_t& primitive = m_primitives[primitive_index];
+        const viewport_t& viewport = m_viewports[primitive.viewport_index];
+        ibounds2d_t region;
+        region.minima.x = maximum<int32_t>((int32_t)viewport.x, (int32_t)tile.x);
+        region.minima.y = maximum<int32_t>((int32_t)viewport.y, (int32_t)tile.y);
+        region.maxima.x = minimum<int32_t>((int32_t)(viewport.x + viewport.width), (int32_t)(tile.x + tile.width));
+        region.maxima.y = minimum<int32_t>((int32_t)(viewport.y + viewport.height), (int32_t)(tile.y + tile.height));
+        switch (vertices_per_primitive)
+        {
+            case 1:
+                raster_point(primitive.screen_positions, primitive.attribs, region, primitive.array_index);
+                break;
+            case 2:
+                raster_line(primitive.screen_positions, primitive.attribs, region, primitive.array_index);
+                break;
+            default:
+                raster_triangle(primitive.screen_positions, primitive.attribs, region, primitive.array_index, winding_order, primitive.visibility_id);
+                break;
+        }
+    }
+}
+
+
+float rasterizer_t::triangle_area(const float4_t* screen_positions, front_face_t winding_order, front_face_t& out_order)
+{
+    float4_t v0_s = screen_positions[0];
+    float4_t v1_s = screen_positions[1];
+    float4_t v2_s = screen_positions[2];
+    float area = winding_order == front_face_clockwise 
+                                    ? edge_function(v0_s, v2_s, v1_s) 
+                                    : edge_function(v0_s, v1_s, v2_s);
+    out_order = winding_order; 
+    
+    // Manage the winding order, which affects the area of the triangle.
+    calculate_winding_order(cull_mode, out_order, area);
+    return area;
+}
+
+
+bool rasterizer_t::triangle_fragment(float4_t v0_s, float4_t v1_s, float4_t v2_s, float area, front_face_t order, 
+    int32_t x_s, int32_t y_s, float& z, float& w_inv, float3_t& persp_b)
+{
+    float2_t p = { (float)x_s + 0.5f, (float)y_s + 0.5f };
+    float w0 = 0.f;
+    float w1 = 0.f;
+    float w2 = 0.f;
+    switch (order)
+    {
+        case front_face_counter_clockwise:                
+        {
+            w0 = edge_function(v1_s, v2_s, p); 
+            w1 = edge_function(v2_s, v0_s, p);
+            w2 = edge_function(v0_s, v1_s, p);
+            break;
+        }
+        case front_face_clockwise:
+        {
+            w0 = edge_function(v2_s, v1_s, p); 
+            w1 = edge_function(v0_s, v2_s, p);
+            w2 = edge_function(v1_s, v0_s, p);
+            break;
+        }
+    }
+    if (w0 < 0 || w1 < 0 || w2 < 0)
+    {
+        return false;
+    }
+    // Barycentric coordinates are calculated
+    w0 /= area;
+    w1 /= area;
+    w2 /= area;
+
+    // linearly interpolate z and w
+    w_inv = 1.f / (w0 * v0_s.w + w1 * v1_s.w + w2 * v2_s.w);
+    z = 1.f / (v0_s.z * w0 + v1_s.z * w1 + v2_s.z * w2);
+
+    // Perspective correction on our barycentrics.
+    persp_b = float3_t
+        (
+            w_inv * v0_s.w * w0, 
+            w_inv * v1_s.w * w1, 
+            w_inv * v2_s.w * w2
+        );
+    return true;
+}
+
+
+void rasterizer_t::raster_triangle(const float4_t* screen_positions, const uintptr_t* attribs, const ibounds2d_t& region, uint32_t array_index, front_face_t winding_order, uint32_t visibility_id)
+{
+    const uintptr_t attrib_v0 = attribs[0];
+    const uintptr_t attrib_v1 = attribs[1];
+    const uintptr_t attrib_v2 = attribs[2];
+
+    // Triangles are in raster space, projected when binned. (except 1 / w)
+    // The vertex pool is left untouched, since vertices may be shared between views.
+    float4_t v0_s = screen_positions[0];
+    float4_t v1_s = screen_positions[1];
+    float4_t v2_s = screen_positions[2];
+
+    front_face_t current_order = winding_order; 
+    float area = triangle_area(screen_positions, winding_order, current_order);
+
+    // Cull if area is negative.
+    if (area < 0)
+        return;
+
+    // We use raster space to calculate the bounding box of the 
+    // triangle on screen, to which here we then perform the actual rasterization.
+    ibounds2d_t bounds = calculate_bounding_volume2d(v0_s, v1_s, v2_s, region);
+
+    // This is not the most optimal way to rasterize a triangle, but it beats
+    // traversing the entire framebuffer, in order to check for shaded fragments 
+    // that are covered.
+    for (int32_t y_s = bounds.minima.y; y_s < bounds.maxima.y; ++y_s)
+    {
+        for (int32_t x_s = bounds.minima.x; x_s < bounds.maxima.x; ++x_s)
+        {
+            float z;
+            float w_inv;
+            float3_t persp_b;
+            // rasterize!
+            if (triangle_fragment(v0_s, v1_s, v2_s, area, current_order, x_s, y_s, z, w_inv, persp_b))
+            {
+                (this->*m_raster_kernel)(x_s, y_s, z, w_inv, array_index, attrib_v0, attrib_v1, attrib_v2, persp_b, visibility_id);
+            }
+        }
+    }
+}
+
+
+void rasterizer_t::raster_line(const float4_t* screen_positions, const uintptr_t* attribs, const ibounds2d_t& region, uint32_t array_index)
+{
+    float4_t v0_s = screen_positions[0];
+    float4_t v1_s = screen_positions[1];
+
+    // DDA, stepping one pixel at a time along the major axis of the line.
+    const float dx = v1_s.x - v0_s.x;
+    const float dy = v1_s.y - v0_s.y;
+    const bool x_major = fabsf(dx) >= fabsf(dy);
+    const uint32_t steps = (uint32_t)maximum<float>(fabsf(dx), fabsf(dy));
+    const float step_inv = steps ? 1.f / (float)steps : 0.f;
+
+    // Wide lines are expanded along the minor axis, centered on the line.
+    const int32_t width = maximum<int32_t>(1, (int32_t)(m_line_width + 0.5f));
+    const int32_t span_begin = -(width - 1) / 2;
+    const int32_t span_end = span_begin + width;
+
+    const int32_t min_x = region.minima.x;
+    const int32_t min_y = region.minima.y;
+    const int32_t max_x = region.maxima.x;
+    const int32_t max_y = region.maxima.y;
+
+    for (uint32_t step = 0; step <= steps; ++step)
+    {
+        const float t = (float)step * step_inv;
+        const float x = v0_s.x + dx * t;
+        const float y = v0_s.y + dy * t;
+
+        // Same depth as the triangle path, and perspective correct t for the attributes.
+        float w_inv = 1.f / ((1.f - t) * v0_s.w + t * v1_s.w);
+        float z = 1.f / ((1.f - t) * v0_s.z + t * v1_s.z);
+        const float t_persp = w_inv * v1_s.w * t;
+        const float3_t persp_b = float3_t(1.f - t_persp, t_persp, 0.f);
+
+        for (int32_t offset = span_begin; offset < span_end; ++offset)
+        {
+            const int32_t x_s = (int32_t)floorf(x) + (x_major ? 0 : offset);
+            const int32_t y_s = (int32_t)floorf(y) + (x_major ? offset : 0);
+            if (x_s < min_x || x_s >= max_x || y_s < min_y || y_s >= max_y)
+            {
+                continue;
+            }
+            (this->*m_raster_kernel)(x_s, y_s, z, w_inv, array_index, attribs[0], attribs[1], attribs[1], persp_b, 0);
+        }
+    }
+}
+
+
+void rasterizer_t::raster_point(const float4_t* screen_positions, const uintptr_t* attribs, const ibounds2d_t& region, uint32_t array_index)
+{
+    float4_t v0_s = screen_positions[0];
+
+    // Points are rasterized as screen aligned squares, covering every pixel center inside of the sprite.
+    const float half_size = maximum<float>(1.f, m_point_size) * 0.5f;
+    fbounds2d_t sprite;
+    sprite.minima = float2_t(v0_s.x - half_size, v0_s.y - half_size);
+    sprite.maxima = float2_t(v0_s.x + half_size, v0_s.y + half_size);
+    const int32_t begin_x = maximum<int32_t>(region.minima.x, (int32_t)ceilf(sprite.minima.x - 0.5f));
+    const int32_t begin_y = maximum<int32_t>(region.minima.y, (int32_t)ceilf(sprite.minima.y - 0.5f));
+    const int32_t end_x = minimum<int32_t>(region.maxima.x, (int32_t)ceilf(sprite.maxima.x - 0.5f));
+    const int32_t end_y = minimum<int32_t>(region.maxima.y, (int32_t)ceilf(sprite.maxima.y - 0.5f));
+
+    // Attributes are constant across the sprite.
+    const float3_t persp_b = float3_t(1.f, 0.f, 0.f);
+    const float z = 1.f / v0_s.z;
+    const float w_inv = 1.f / v0_s.w;
+    for (int32_t y_s = begin_y; y_s < end_y; ++y_s)
+    {
+        for (int32_t x_s = begin_x; x_s < end_x; ++x_s)
+        {
+            (this->*m_raster_kernel)(x_s, y_s, z, w_inv, array_index, attribs[0], attribs[0], attribs[0], persp_b, 0);
+        }
+    }
+}
+
+
+template<bool depth_enabled, compare_op_t compare_op, bool depth_write_enabled, bool visibility>
+void rasterizer_t::shade_fragment(int32_t x_s, int32_t y_s, float z, float w_inv, uint32_t array_index, 
+    uintptr_t attrib_v0, uintptr_t attrib_v1, uintptr_t attrib_v2, const float3_t& persp_b, uint32_t visibility_id)
+{
+    if (depth_enabled)
+    {
+        float dest_value = rop.read_depth_stencil(m_bound_framebuffer, array_index, x_s, y_s);
+        if (!is_pass_depth_test(compare_op, dest_value, z))
+        {
+            // Failed depth test, don't write to pixel.
+            return;
+        }
+    }
+
+    if (visibility)
+    {
+        // Shaded once resolved, by whichever primitive is left.
+        const uint32_t width = m_visibility_buffer->get_width();
+        m_visibility_buffer->get_ids()[((uint64_t)array_index * m_visibility_buffer->get_height() + y_s) * width + x_s] = visibility_id;
+    }
+    else
+    {
+        shade_pixel(m_bound_pixel_shader, m_interpolator, x_s, y_s, z, w_inv, array_index, attrib_v0, attrib_v1, attrib_v2, persp_b);
+    }
+    if (depth_enabled && depth_write_enabled)
+    {
+        rop.write_to_depth_stencil(m_bound_framebuffer, array_index, x_s, y_s, z);
+    }
+}
+
+
+void rasterizer_t::shade_pixel(pixel_shader_t* pixel_shader, const interpolator_layout_t& interpolator, int32_t x_s, int32_t y_s, float z, float w_inv, 
+    uint32_t array_index, uintptr_t attrib_v0, uintptr_t attrib_v1, uintptr_t attrib_v2, const float3_t& persp_b)
+{
+    // 
+    uintptr_t varying_address = allocate_varying();
+
+    for (uint32_t run_i = 0; run_i < interpolator.num_runs; ++run_i)
+    {
+        const interpolator_layout_t::run_t& run = interpolator.runs[run_i];
+        float* out = (float*)(varying_address + run.offset_bytes);
+        const float* d0 = (const float*)(attrib_v0 + run.offset_bytes);
+        const float* d1 = (const float*)(attrib_v1 + run.offset_bytes);
+        const float* d2 = (const float*)(attrib_v2 + run.offset_bytes);
+        for (uint32_t i = 0; i < run.num_floats; ++i)
+        {
+            out[i] = d0[i] * persp_b[0] + d1[i] * persp_b[1] + d2[i] * persp_b[2];
+        }
+    }
+
+    // Position is passed along in raster space.
+    *(float4_t*)(varying_address + interpolator.position_offset_bytes) = float4_t((float)x_s + 0.5f, (float)y_s + 0.5f, z, w_inv);
+    
+    // execute the bound pixel shader. This should probably be optimized!
+    float4_t output = pixel_shader ? pixel_shader->execute(varying_address) : float4_t(0, 0, 0, 0);
+
+    // Finally, store the shaded pixel into the framebuffer.
+    rop.shade_to_output(m_bound_framebuffer, 0, array_index, x_s, y_s, output);
+}
+
+
+// Kernels for every depth compare op, with and without depth writes.
+template<bool depth_write_enabled, bool visibility>
+rasterizer_t::fragment_kernel_t rasterizer_t::select_depth_kernel(compare_op_t compare_op)
+{
+    switch (compare_op)
+    {
+        case compare_op_equal:
+            return &rasterizer_t::shade_fragment<true, compare_op_equal, depth_write_enabled, visibility>;
+        case compare_op_less:
+            return &rasterizer_t::shade_fragment<true, compare_op_less, depth_write_enabled, visibility>;
+        case compare_op_less_equal:
+            return &rasterizer_t::shade_fragment<true, compare_op_less_equal, depth_write_enabled, visibility>;
+        case compare_op_greater:
+            return &rasterizer_t::shade_fragment<true, compare_op_greater, depth_write_enabled, visibility>;
+        case compare_op_greater_equal:
+            return &rasterizer_t::shade_fragment<true, compare_op_greater_equal, depth_write_enabled, visibility>;
+        default:
+            break;
+    }
+    return &rasterizer_t::shade_fragment<true, compare_op_none, depth_write_enabled, visibility>;
+}
+
+
+rasterizer_t::fragment_kernel_t rasterizer_t::select_fragment_kernel(bool depth_enabled, compare_op_t compare_op, bool depth_write_enabled, bool visibility)
+{
+    if (visibility)
+    {
+        if (!depth_enabled)
+        {
+            return &rasterizer_t::shade_fragment<false, compare_op_none, false, true>;
+        }
+        return depth_write_enabled ? select_depth_kernel<true, true>(compare_op) : select_depth_kernel<false, true>(compare_op);
+    }
+    if (!depth_enabled)
+    {
+        return &rasterizer_t::shade_fragment<false, compare_op_none, false, false>;
+    }
+    return depth_write_enabled ? select_depth_kernel<true, false>(compare_op) : select_depth_kernel<false, false>(compare_op);
+}
+
+
+void interpolator_layout_t::build(const pixel_shader_t& shader)
+{
+    num_runs = 0;
+    position_offset_bytes = shader.get_position_offset_bytes();
+    for (const pixel_shader_t::varying_info& info : shader.get_varying_metadata())
+    {
+        const uint32_t offset_bytes = (uint32_t)info.offset;
+        const uint32_t num_floats = (uint32_t)info.type - pixel_shader_t::data_type_float + 1;
+        run_t* last = num_runs ? &runs[num_runs - 1] : nullptr;
+        if (last && last->offset_bytes + last->num_floats * sizeof(float) == offset_bytes)
+        {
+            last->num_floats += num_floats;
+            continue;
+        }
+        if (num_runs == SWRAST_MAX_VARYING_SIZE_BYTES / sizeof(float))
+        {
+            break;
+        }
+        runs[num_runs].offset_bytes = offset_bytes;
+        runs[num_runs].num_floats = num_floats;
+        ++num_runs;
+    }
+}
+
+
+void rasterizer_t::bind_pipeline_state(const raster_state_t& state)
+{
+    m_bound_pixel_shader = state.pixel_shader;
+    cull_mode = state.cull_mode;
+    depth_compare = state.depth_compare;
+    m_depth_enabled = state.depth_enabled;
+    m_depth_write_enabled = state.depth_write_enabled;
+    m_line_width = state.line_width;
+    m_point_size = state.point_size;
+    m_fragment_kernel = state.fragment_kernel;
+    m_interpolator = state.interpolator;
+    m_interpolator_dirty = false;
+}
+
+
 float rasterizer_t::edge_function(const float2_t& a, const float2_t& b, const float2_t& c)
 {
     return (c[0] - a[0]) * (b[1] - a[1]) - (c[1] - a[1]) * (b[0] - a[0]); 
 }
 
 
-ibounds2d_t rasterizer_t::calculate_bounding_volume2d(const float2_t& a, const float2_t& b, const float2_t& c)
+ibounds2d_t rasterizer_t::calculate_bounding_volume2d(const float2_t& a, const float2_t& b, const float2_t& c, const ibounds2d_t& region)
 {
+    const float min_x = (float)region.minima.x;
+    const float min_y = (float)region.minima.y;
+    const float max_x = (float)region.maxima.x;
+    const float max_y = (float)region.maxima.y;
     ibounds2d_t bounds;
-    bounds.maxima.x = (int32_t)clamp<float>(maximum<float>(maximum<float>(a.x, b.x), c.x), 0.f, m_viewports[0].width);
-    bounds.maxima.y = (int32_t)clamp<float>(maximum<float>(maximum<float>(a.y, b.y), c.y), 0.f, m_viewports[0].height);
-    bounds.minima.x = (int32_t)clamp<float>(minimum<float>(minimum<float>(a.x, b.x), c.x), 0.f, m_viewports[0].width);
-    bounds.minima.y = (int32_t)clamp<float>(minimum<float>(minimum<float>(a.y, b.y), c.y), 0.f, m_viewports[0].height);
+    bounds.maxima.x = (int32_t)clamp<float>(maximum<float>(maximum<float>(a.x, b.x), c.x), min_x, max_x);
+    bounds.maxima.y = (int32_t)clamp<float>(maximum<float>(maximum<float>(a.y, b.y), c.y), min_y, max_y);
+    bounds.minima.x = (int32_t)clamp<float>(minimum<float>(minimum<float>(a.x, b.x), c.x), min_x, max_x);
+    bounds.minima.y = (int32_t)clamp<float>(minimum<float>(minimum<float>(a.y, b.y), c.y), min_y, max_y);
     return bounds;
 }
 
 
 error_t rasterizer_t::set_viewports(uint32_t num_viewports, viewport_t* viewports)
 {
+    if (num_viewports == 0 || num_viewports > SWRAST_MAX_VIEWPORTS)
+    {
+        return result_failed;
+    }
     for (uint32_t i = 0; i < num_viewports; ++i)
     {
         m_viewports[i] = viewports[i];
     }
+    m_num_viewports = num_viewports;
     return result_ok;
 }
 
 
-error_t render_output_t::shade_to_output(framebuffer_t& framebuffer, uint32_t index, const viewport_t& viewport, uint32_t x, uint32_t y, const float4_t& color)
+error_t rasterizer_t::set_view_instancing(uint32_t view_count, view_instance_location_t* locations)
 {
-    resource_t render_target = framebuffer.bound_render_targets[index];
-    resource_desc_t* desc = (resource_desc_t*)(render_target - sizeof(resource_desc_t));
-    uintptr_t format_size = format_size_bytes(desc->format);
-    uintptr_t ptr = render_target;
-    // Address must be based on the format of the render target, for this we need to know ahead of time, what
-    // that will be.
-    // TODO: Need to perform the render output based on the byte stride format. Not the other way around!
-    const uintptr_t row_pitch = viewport.width * format_size;
-    store_color(texel(render_target, uint2_t(x, y), format_size, row_pitch, 0), color, desc->format);
+    if (view_count == 0 || view_count > SWRAST_MAX_VIEW_INSTANCES)
+    {
+        return result_failed;
+    }
+    // Views have to land in a viewport, and a slice of the bound targets. Targets bound later are checked when drawing.
+    const uint32_t array_size = get_framebuffer_array_size();
+    for (uint32_t i = 0; i < view_count; ++i)
+    {
+        const uint32_t viewport_array_index = locations ? locations[i].viewport_array_index : 0;
+        const uint32_t render_target_array_index = locations ? locations[i].render_target_array_index : i;
+        if (viewport_array_index >= SWRAST_MAX_VIEWPORTS || render_target_array_index >= array_size)
+        {
+            return result_failed;
+        }
+    }
+    // Without locations, view i goes to slice i, in the first viewport.
+    for (uint32_t i = 0; i < view_count; ++i)
+    {
+        m_view_locations[i].viewport_array_index = locations ? locations[i].viewport_array_index : 0;
+        m_view_locations[i].render_target_array_index = locations ? locations[i].render_target_array_index : i;
+    }
+    m_view_count = view_count;
     return result_ok;
 }
 
 
-error_t render_output_t::write_to_depth_stencil(framebuffer_t& framebuffer, const viewport_t& viewport, uint32_t x_s, uint32_t y_s, float depth)
+// Grab the texel address of a surface, at the given pixel and array slice. Row and slice pitch 
+// are taken from the resource itself, so multiple viewports can address the same surface.
+static uintptr_t surface_texel(resource_t surface, uint32_t x, uint32_t y, uint32_t array_index, format_t& out_format)
+{
+    resource_desc_t* desc = (resource_desc_t*)(surface - sizeof(resource_desc_t));
+    const uint32_t format_size = format_size_bytes(desc->format);
+    const uint32_t row_pitch = desc->width * format_size;
+    const uint32_t slice_pitch = desc->height * row_pitch;
+    out_format = desc->format;
+    return texel(surface, uint3_t(x, y, array_index), format_size, row_pitch, slice_pitch);
+}
+
+
+error_t render_output_t::shade_to_output(framebuffer_t& framebuffer, uint32_t index, uint32_t array_index, uint32_t x, uint32_t y, const float4_t& color)
+{
+    resource_t render_target = framebuffer.bound_render_targets[index];
+    if (render_target)
+    {
+        format_t format = format_unknown;
+        uintptr_t address = surface_texel(render_target, x, y, array_index, format);
+        store_color(address, color, format);
+        return result_ok;
+    }
+    return result_failed;
+}
+
+
+error_t render_output_t::write_to_depth_stencil(framebuffer_t& framebuffer, uint32_t array_index, uint32_t x_s, uint32_t y_s, float depth)
 {
     resource_t depth_stencil = framebuffer.bound_depth_stencil;
-    resource_desc_t* desc = (resource_desc_t*)(depth_stencil - sizeof(resource_desc_t));
-    uintptr_t format_size = format_size_bytes(desc->format);
     if (depth_stencil)
     {
-        uintptr_t base_address = depth_stencil;
-        const uintptr_t row_pitch = viewport.width * format_size;
-        store_color(texel(depth_stencil, uint2_t(x_s, y_s), format_size, row_pitch, 0), float4_t(depth, depth, depth, depth), desc->format);
+        format_t format = format_unknown;
+        uintptr_t address = surface_texel(depth_stencil, x_s, y_s, array_index, format);
+        store_color(address, float4_t(depth, depth, depth, depth), format);
+        return result_ok;
     }
     return result_failed;
 }
 
 
-float render_output_t::read_depth_stencil(const framebuffer_t& framebuffer, const viewport_t& viewport, uint32_t x_s, uint32_t y_s)
+float render_output_t::read_depth_stencil(const framebuffer_t& framebuffer, uint32_t array_index, uint32_t x_s, uint32_t y_s)
 {
     const resource_t depth_stencil = framebuffer.bound_depth_stencil;
-    resource_desc_t* desc = (resource_desc_t*)(depth_stencil - sizeof(resource_desc_t));
-    uintptr_t format_size = format_size_bytes(desc->format);
     float value = 0.f;
     if (depth_stencil)
     {
-        const uintptr_t base_address = depth_stencil;
-        const uintptr_t row_pitch = viewport.width * format_size;
-        value = load_color(texel(depth_stencil, uint2_t(x_s, y_s), format_size, row_pitch, 0), desc->format).x;
+        format_t format = format_unknown;
+        uintptr_t address = surface_texel(depth_stencil, x_s, y_s, array_index, format);
+        value = load_color(address, format).x;
     }
     return value;
 }
 
 
-error_t render_output_t::clear_render_target(framebuffer_t& framebuffer, uint32_t index, const rect_t& rect, const float4_t& clear_color)
+error_t render_output_t::clear_render_target(framebuffer_t& framebuffer, uint32_t index, const rect_t& rect, const float4_t& clear_color, job_system_t* job_system)
 {
     resource_t rt = framebuffer.bound_render_targets[index];
     resource_desc_t* resource_desc = (resource_desc_t*)(rt - sizeof(resource_desc_t));
@@ -313,18 +918,28 @@ error_t render_output_t::clear_render_target(framebuffer_t& framebuffer, uint32_
     // TODO: This needs to be configurable! Render target row_pitch needs to be the max width size!
     uint32_t row_pitch = resource_desc->width * format_size;
     uint32_t depth = resource_desc->height * row_pitch;
-    for (uint32_t y = rect.y; y < rect.y + rect.height; ++y)
+    const uint32_t array_size = surface_array_size(*resource_desc);
+    const format_t format = resource_desc->format;
+    const uint32_t height = resource_desc->height;
+    const auto row_owner = [&] (uint32_t begin) { return job_system->get_row_owner(rect.y + begin % rect.height, height); };
+    // Every row of every slice is independent.
+    job_system->parallel_for_owned(array_size * rect.height, SWRAST_CLEAR_ROWS_PER_JOB, row_owner, [&] (uint32_t begin, uint32_t end)
     {
-        for (uint32_t x = rect.x; x < rect.x + rect.width; ++x)
+        for (uint32_t row = begin; row < end; ++row)
         {
-            store_color(texel(rt, uint2_t(x, y), format_size, row_pitch, depth), clear_color, resource_desc->format); 
+            const uint32_t z = row / rect.height;
+            const uint32_t y = rect.y + row % rect.height;
+            for (uint32_t x = rect.x; x < rect.x + rect.width; ++x)
+            {
+                store_color(texel(rt, uint3_t(x, y, z), format_size, row_pitch, depth), clear_color, format); 
+            }
         }
-    }
+    });
     return result_ok;
 }
 
 
-error_t render_output_t::clear_depth_stencil(framebuffer_t& framebuffer, const rect_t& rect, float depth)
+error_t render_output_t::clear_depth_stencil(framebuffer_t& framebuffer, const rect_t& rect, float depth, job_system_t* job_system)
 {   
     resource_t ds = framebuffer.bound_depth_stencil;
     resource_desc_t* resource_desc = (resource_desc_t*)(ds - sizeof(resource_desc_t));
@@ -332,32 +947,59 @@ error_t render_output_t::clear_depth_stencil(framebuffer_t& framebuffer, const r
     // TODO: This needs to be configurable! Render target row_pitch needs to be the max width size!
     uint32_t row_pitch = resource_desc->width * format_size;
     uint32_t z_depth = resource_desc->height * row_pitch;
-    for (uint32_t y = rect.y; y < rect.y + rect.height; ++y)
+    const uint32_t array_size = surface_array_size(*resource_desc);
+    const format_t format = resource_desc->format;
+    const uint32_t height = resource_desc->height;
+    const auto row_owner = [&] (uint32_t begin) { return job_system->get_row_owner(rect.y + begin % rect.height, height); };
+    job_system->parallel_for_owned(array_size * rect.height, SWRAST_CLEAR_ROWS_PER_JOB, row_owner, [&] (uint32_t begin, uint32_t end)
     {
-        for (uint32_t x = rect.x; x < rect.x + rect.width; ++x)
+        for (uint32_t row = begin; row < end; ++row)
         {
-            store_color(texel(ds, uint2_t(x, y), format_size, row_pitch, z_depth), float4_t(depth, depth, depth, depth), resource_desc->format); 
+            const uint32_t z = row / rect.height;
+            const uint32_t y = rect.y + row % rect.height;
+            for (uint32_t x = rect.x; x < rect.x + rect.width; ++x)
+            {
+                store_color(texel(ds, uint3_t(x, y, z), format_size, row_pitch, z_depth), float4_t(depth, depth, depth, depth), format); 
+            }
         }
-    }
-    return result_ok;
+    });
     return result_ok;
 }
 
 
-uintptr_t rasterizer_t::allocate_varying()
+uint32_t rasterizer_t::get_framebuffer_height() const
 {
-    uintptr_t varying_ptr = (uintptr_t)per_pixel_varying_allocator.allocate(varying_max_size_bytes, 4);
-    return varying_ptr;
+    resource_t target = m_bound_framebuffer.num_render_targets ? m_bound_framebuffer.bound_render_targets[0] : m_bound_framebuffer.bound_depth_stencil;
+    if (!target)
+    {
+        return 0;
+    }
+    return ((const resource_desc_t*)(target - sizeof(resource_desc_t)))->height;
 }
 
 
-void rasterizer_t::allocate_varying_heap(size_t size_bytes)
+uint32_t rasterizer_t::get_framebuffer_array_size() const
 {
-    const uint64_t size = per_pixel_varying_allocator.get_memory_pool_size_bytes();
-    if (size_bytes > size)
+    uint32_t array_size = UINT32_MAX;
+    for (uint32_t i = 0; i < m_bound_framebuffer.num_render_targets; ++i)
     {
-        per_pixel_varying_allocator.resize_pool(size_bytes);
+        if (m_bound_framebuffer.bound_render_targets[i])
+        {
+            const resource_desc_t* desc = (const resource_desc_t*)(m_bound_framebuffer.bound_render_targets[i] - sizeof(resource_desc_t));
+            array_size = minimum<uint32_t>(array_size, surface_array_size(*desc));
+        }
+    }
+    if (m_bound_framebuffer.bound_depth_stencil)
+    {
+        const resource_desc_t* desc = (const resource_desc_t*)(m_bound_framebuffer.bound_depth_stencil - sizeof(resource_desc_t));
+        array_size = minimum<uint32_t>(array_size, surface_array_size(*desc));
     }
-    per_pixel_varying_allocator.reset();
+    return array_size;
+}
+
+
+uintptr_t rasterizer_t::allocate_varying()
+{
+    return m_varying_scratch.get_base_address() + job_system_t::get_thread_index() * varying_max_size_bytes;
 }
 } // swrast
\ No newline at end of file
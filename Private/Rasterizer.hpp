@@ -1,14 +1,22 @@
 //
+#pragma once
 #include "Context.hpp"
 #include "Math.hpp"
 #include "InputAssembly.hpp"
 #include "Allocator.hpp"
+#include "Memory.hpp"
+#include "JobSystem.hpp"
 #include <cstdint>
+#include <vector>
 
 namespace swrast {
 
 
 class render_output_t;
+class visibility_buffer_t;
+
+// Depth test, returns true if the source depth passes against the destination depth.
+extern bool is_pass_depth_test(compare_op_t op, float dest_depth, float source_depth);
 
 struct framebuffer_t
 {
@@ -28,20 +36,21 @@ public:
     // shade the framebuffer render target.
     //
     // index = render target index.   
+    // array_index = slice of the render target, if the render target is an array.
     // x_s = x pixel in screen space.
     // y_s = y pixel in screen space.
     // color = output color to color the pixel.
     //
-    error_t shade_to_output(framebuffer_t& framebuffer, uint32_t index, const viewport_t& viewport, uint32_t x_s, uint32_t y_s, const float4_t& color);
+    error_t shade_to_output(framebuffer_t& framebuffer, uint32_t index, uint32_t array_index, uint32_t x_s, uint32_t y_s, const float4_t& color);
 
     // Write to the depth stencil buffer, if one is bounded. This must also mean that the 
     // config to handle depth testing, must be enabled.
-    error_t write_to_depth_stencil(framebuffer_t& framebuffer, const viewport_t& viewport, uint32_t x_s, uint32_t y_s, float depth);
-    float read_depth_stencil(const framebuffer_t& framebuffer, const viewport_t& viewport, uint32_t x_s, uint32_t y_s);
-    // Clear a render target in the framebuffer.
-    error_t clear_render_target(framebuffer_t& framebuffer, uint32_t index, const rect_t& rect, const float4_t& clear_color);
-    // Clear depth stencil in the frame buffer.
-    error_t clear_depth_stencil(framebuffer_t& framebuffer, const rect_t& rect, float depth);
+    error_t write_to_depth_stencil(framebuffer_t& framebuffer, uint32_t array_index, uint32_t x_s, uint32_t y_s, float depth);
+    float read_depth_stencil(const framebuffer_t& framebuffer, uint32_t array_index, uint32_t x_s, uint32_t y_s);
+    // Clear a render target in the framebuffer. All array slices are cleared. Rows are cleared in parallel.
+    error_t clear_render_target(framebuffer_t& framebuffer, uint32_t index, const rect_t& rect, const float4_t& clear_color, job_system_t* job_system);
+    // Clear depth stencil in the frame buffer. All array slices are cleared. Rows are cleared in parallel.
+    error_t clear_depth_stencil(framebuffer_t& framebuffer, const rect_t& rect, float depth, job_system_t* job_system);
 private:
     
 };
@@ -94,6 +103,14 @@ private:
 };
 
 
+// Width and height of a framebuffer tile, in pixels. Tiles are rasterized in parallel.
+#define SWRAST_TILE_SIZE 64
+// Number of rows cleared by a single job.
+#define SWRAST_CLEAR_ROWS_PER_JOB 32
+// Draws binning fewer primitives than this, over all tiles, are rasterized on the calling thread. Waking workers 
+// for a handful of small triangles costs more than rasterizing them.
+#define SWRAST_MIN_PARALLEL_BINNED_PRIMITIVES 64
+
 // framebuffer tile.
 struct tile_t
 {
@@ -105,49 +122,155 @@ struct tile_t
 };
 
 
+// Varyings are interpolated as runs of floats, with perspective correct barycentrics. Attributes laid out 
+// back to back are merged into a single run.
+struct interpolator_layout_t
+{
+    struct run_t
+    {
+        uint32_t offset_bytes;
+        uint32_t num_floats;
+    };
+
+    run_t       runs[SWRAST_MAX_VARYING_SIZE_BYTES / sizeof(float)];
+    uint32_t    num_runs;
+    uint32_t    position_offset_bytes;
+
+    void build(const pixel_shader_t& shader);
+};
+
+
+struct raster_state_t;
+
 // Rasterizer performs the actual work of projecting the clip space vertices into pixel space, or screen space.
 // Should handle typical needs such as perspective projection, vertex interpolation with barycentrics, and 
 // invoking the given pixel shader.
 class rasterizer_t 
 {
 public:
-    error_t initialize(const fbounds3d_t& ndc) { ndc_space = ndc; return result_ok; }
+    error_t initialize(const fbounds3d_t& ndc, job_system_t* job_system) { ndc_space = ndc; m_job_system = job_system; return result_ok; }
     error_t release() { return result_ok; }
 
     // Bind a framebuffer to this rasterizer.
     error_t bind_frame_buffer(framebuffer_t framebuffer) { m_bound_framebuffer = framebuffer; return result_ok; }
 
-    // Perform rasterization with the given input triangles.
-    // Triangles must be in clip space. Perspective projection will be conducted in here.
-    error_t raster(uint32_t num_triangles, vertices_t& vertices, front_face_t winding_order);
+    // Perform rasterization with the given input primitives. 1 vertex per primitive are points, 2 are lines, and 3 are triangles.
+    // Primitives must be in clip space. Perspective projection will be conducted in here.
+    // Primitives are binned into screen tiles, and tiles are rasterized in parallel. Each pixel belongs to a single tile, 
+    // and its tile rasterizes its primitives in submission order, so results match serial rasterization.
+    error_t raster(uint32_t num_primitives, uint32_t vertices_per_primitive, vertices_t& vertices, front_face_t winding_order);
+
+    // Depth test, shade and output a single fragment, specialized for the depth state. Shared by every primitive type. 
+    // Barycentrics must be perspective correct. Visibility kernels write the visibility id of the primitive, instead 
+    // of shading.
+    typedef void (rasterizer_t::*fragment_kernel_t)(int32_t x_s, int32_t y_s, float z, float w_inv, uint32_t array_index, 
+        uintptr_t attrib_v0, uintptr_t attrib_v1, uintptr_t attrib_v2, const float3_t& persp_b, uint32_t visibility_id);
+
+    static fragment_kernel_t select_fragment_kernel(bool depth_enabled, compare_op_t compare_op, bool depth_write_enabled, bool visibility = false);
 
-    // Bind the pixel shader, this is invoked per pixel.
-    error_t bind_pixel_shader(pixel_shader_t* shader) { m_bound_pixel_shader = shader; return result_ok; }
+    // Bind the pixel shader, this is invoked per pixel. Its interpolator layout is built by the next raster call.
+    error_t bind_pixel_shader(pixel_shader_t* shader) { m_bound_pixel_shader = shader; m_interpolator_dirty = true; return result_ok; }
+    // Bind a pixel shader with the same varyings as the bound one, such as a snapshot of it. The layout is kept.
+    error_t rebind_pixel_shader(pixel_shader_t* shader) { m_bound_pixel_shader = shader; return result_ok; }
+    // Bind every state of a pipeline state object at once, with its interpolator layout and kernel already derived.
+    void bind_pipeline_state(const raster_state_t& state);
+    pixel_shader_t* get_pixel_shader() { return m_bound_pixel_shader; }
+    // Interpolator layout of the bound pixel shader.
+    const interpolator_layout_t& get_interpolator();
+
+    // With a visibility buffer, triangles only write depth, and their visibility id, and are shaded once the 
+    // visibility buffer is resolved. Only triangles are supported. nullptr goes back to shading right away.
+    void set_visibility_buffer(visibility_buffer_t* visibility_buffer) { m_visibility_buffer = visibility_buffer; }
+    // Shade every pixel with a visibility id, with the pixel shader of its draw, into render target 0. 
+    // Pixels of a draw are shaded in parallel, one draw after the other.
+    void resolve_visibility();
     
     error_t set_viewports(uint32_t num_viewports, viewport_t* viewports);
-    void enable_depth(bool enable) { m_depth_enabled = enable; }
-    void enable_write_depth(bool enable) { m_depth_write_enabled = enable;  }
+    error_t set_view_instancing(uint32_t view_count, view_instance_location_t* locations);
+    void enable_depth(bool enable) { m_depth_enabled = enable; update_fragment_kernel(); }
+    void enable_write_depth(bool enable) { m_depth_write_enabled = enable; update_fragment_kernel(); }
 
-    error_t clear_render_target(uint32_t index, const rect_t& rect, const float4_t& clear_color) { return rop.clear_render_target(m_bound_framebuffer, index, rect, clear_color); }
-    error_t clear_depth_stencil(const rect_t& rect, float depth) { return rop.clear_depth_stencil(m_bound_framebuffer, rect, depth); }
+    error_t clear_render_target(uint32_t index, const rect_t& rect, const float4_t& clear_color) { return rop.clear_render_target(m_bound_framebuffer, index, rect, clear_color, m_job_system); }
+    error_t clear_depth_stencil(const rect_t& rect, float depth) { return rop.clear_depth_stencil(m_bound_framebuffer, rect, depth, m_job_system); }
     render_output_t& get_rop() { return rop; }
+    framebuffer_t& get_frame_buffer() { return m_bound_framebuffer; }
+    const viewport_t& get_viewport(uint32_t index) const { return m_viewports[index]; }
+    compare_op_t get_depth_compare_op() const { return depth_compare; }
+    bool is_depth_enabled() const { return m_depth_enabled; }
+    bool is_depth_write_enabled() const { return m_depth_enabled && m_depth_write_enabled; }
 
-    void set_depth_compare_op(compare_op_t compare_op) { depth_compare = compare_op; }
+    void set_depth_compare_op(compare_op_t compare_op) { depth_compare = compare_op; update_fragment_kernel(); }
     void set_cull_mode(cull_mode_t cull) { cull_mode = cull; }
+    void set_line_width(float width) { m_line_width = width; }
+    void set_point_size(float size) { m_point_size = size; }
 
 private:
 
-    // Allocate a varying struct.
-    uintptr_t allocate_varying();
+    // Primitive set up for binning. Shared by every tile the primitive overlaps. Vertices are projected once, 
+    // when binning, and every tile reuses the screen positions.
+    struct binned_primitive_t
+    {
+        float4_t    screen_positions[3];
+        uintptr_t   attribs[3];
+        uint32_t    viewport_index;
+        uint32_t    array_index;
+        uint32_t    visibility_id;
+    };
+
+    // Record the triangle into the visibility buffer. Returns false if the triangle is culled.
+    bool record_visibility(binned_primitive_t& primitive, uintptr_t vertices_base, uintptr_t vertices_copy, front_face_t winding_order);
+
+    // Screen bounds of the primitive, clamped to its viewport.
+    ibounds2d_t primitive_bounds(const binned_primitive_t& primitive, uint32_t vertices_per_primitive);
 
-    void allocate_varying_heap(size_t size_bytes);    
+    // Rasterize the primitives binned into the tile.
+    void raster_tile(uint32_t tile_index, uint32_t vertices_per_primitive, front_face_t winding_order);
 
-    // Projects ndc coordinates to screen coordinates.
-    float4_t ndc_to_screen(float4_t ndc_coord);
+    // Rasterize a single triangle, given its screen space positions and vertex attributes, into the render target slice.
+    // Only pixels within the region (the viewport, clipped to the tile) are rasterized.
+    void raster_triangle(const float4_t* screen_positions, const uintptr_t* attribs, const ibounds2d_t& region, uint32_t array_index, front_face_t winding_order, uint32_t visibility_id);
+
+    // Signed area of the triangle, and the winding order its pixels are tested with, for the bound cull mode. Culled if negative.
+    float triangle_area(const float4_t* screen_positions, front_face_t winding_order, front_face_t& out_order);
+    // Depth, 1 / w and perspective correct barycentrics of the pixel. Returns false if the pixel center is outside of the triangle.
+    bool triangle_fragment(float4_t v0_s, float4_t v1_s, float4_t v2_s, float area, front_face_t order, 
+        int32_t x_s, int32_t y_s, float& z, float& w_inv, float3_t& persp_b);
+
+    // Rasterize a line, with a DDA. Lines wider than 1 pixel are expanded along the minor axis.
+    void raster_line(const float4_t* screen_positions, const uintptr_t* attribs, const ibounds2d_t& region, uint32_t array_index);
+
+    // Rasterize a point as a screen aligned sprite.
+    void raster_point(const float4_t* screen_positions, const uintptr_t* attribs, const ibounds2d_t& region, uint32_t array_index);
+
+    template<bool depth_enabled, compare_op_t compare_op, bool depth_write_enabled, bool visibility>
+    void shade_fragment(int32_t x_s, int32_t y_s, float z, float w_inv, uint32_t array_index, 
+        uintptr_t attrib_v0, uintptr_t attrib_v1, uintptr_t attrib_v2, const float3_t& persp_b, uint32_t visibility_id);
+
+    // Interpolate the varyings, run the pixel shader, and store the color. Past the depth test.
+    void shade_pixel(pixel_shader_t* pixel_shader, const interpolator_layout_t& interpolator, int32_t x_s, int32_t y_s, float z, float w_inv, 
+        uint32_t array_index, uintptr_t attrib_v0, uintptr_t attrib_v1, uintptr_t attrib_v2, const float3_t& persp_b);
+
+    template<bool depth_write_enabled, bool visibility>
+    static fragment_kernel_t select_depth_kernel(compare_op_t compare_op);
+    void update_fragment_kernel() { m_fragment_kernel = select_fragment_kernel(m_depth_enabled, depth_compare, m_depth_write_enabled); }
+
+    // Get the varying struct of the calling thread. Varyings only live as long as the fragment.
+    uintptr_t allocate_varying();
+    // Height of the bound render target 0, or of the depth stencil without render targets.
+    uint32_t get_framebuffer_height() const;
+    // Slices every bound render target, and the depth stencil, hold. The smallest of their array sizes, or
+    // UINT32_MAX when nothing is bound.
+    uint32_t get_framebuffer_array_size() const;
+
+    // Projects ndc coordinates to screen coordinates, with the given viewport.
+    float4_t ndc_to_screen(float4_t ndc_coord, const viewport_t& viewport);
     float4_t clip_to_ndc(float4_t clip);
 
-    // calculate the bounding volume of a triangle, with the given 3 points in screen space.
-    ibounds2d_t calculate_bounding_volume2d(const float2_t& a, const float2_t& b, const float2_t& c);
+    // calculate the bounding volume of a triangle, with the given 3 points in screen space. Clamped to the region.
+    ibounds2d_t calculate_bounding_volume2d(const float2_t& a, const float2_t& b, const float2_t& c, const ibounds2d_t& region);
+
+    // Reads the system value written by the vertex shader at the given offset. Returns 0 if the value is not written.
+    uint32_t read_vertex_system_value(uintptr_t vertex, uint32_t offset);
 
     // Find the edge bounds of the triangle. This calculates if a point is within
     // the area of the triangle.
@@ -157,20 +280,54 @@ private:
     render_output_t rop;
     framebuffer_t   m_bound_framebuffer;
     pixel_shader_t* m_bound_pixel_shader;
-    viewport_t      m_viewports[8];
+    viewport_t      m_viewports[SWRAST_MAX_VIEWPORTS];
+    uint32_t        m_num_viewports = 1;
+    view_instance_location_t m_view_locations[SWRAST_MAX_VIEW_INSTANCES] = { };
+    uint32_t        m_view_count = 1;
     compare_op_t    depth_compare = compare_op_less;
     cull_mode_t     cull_mode = cull_mode_none;
+    float           m_line_width = 1.f;
+    float           m_point_size = 1.f;
     bool            m_depth_enabled = false;
     bool            m_depth_write_enabled = false;
-    linear_allocator_t per_pixel_varying_allocator;
+    fragment_kernel_t m_fragment_kernel = select_fragment_kernel(false, compare_op_less, false);
+    // Kernel of the running raster call, the visibility kernel in visibility passes.
+    fragment_kernel_t m_raster_kernel = m_fragment_kernel;
+    interpolator_layout_t m_interpolator;
+    bool            m_interpolator_dirty = true;
     const uint64_t  varying_max_size_bytes = SWRAST_MAX_VARYING_SIZE_BYTES;
+    job_system_t*   m_job_system = nullptr;
+    visibility_buffer_t* m_visibility_buffer = nullptr;
 
-    // triangle bin, holds triangles that pertain to this bin.
-    struct triangle_bin_t
-    {
-        triangle_t* triangles;
-        uint32_t    num_triangles;
-        uint16_t    bin_id;
-    };
+    // One varying struct per thread of the job system.
+    memory_pool_t   m_varying_scratch;
+
+    // Primitives of the current raster call, and the bins of each tile, holding the indices of the primitives 
+    // overlapping it. Only tiles with primitives are kept in the active list. Reused between calls.
+    std::vector<binned_primitive_t>     m_primitives;
+    std::vector<std::vector<uint32_t>>  m_bins;
+    std::vector<uint32_t>               m_active_tiles;
+    uint32_t                            m_tiles_x = 0;
+    uint32_t                            m_tiles_y = 0;
+
+    // Visible pixels of the visibility buffer, sorted by draw when resolving, and the number of pixels of each draw 
+    // counted by each job. Reused between resolves.
+    std::vector<uint32_t>               m_visible_pixels;
+    std::vector<uint32_t>               m_draw_pixel_counts;
+};
+
+
+// Rasterizer state of a pipeline state object, derived once, when it is created.
+struct raster_state_t
+{
+    pixel_shader_t*                     pixel_shader;
+    cull_mode_t                         cull_mode;
+    compare_op_t                        depth_compare;
+    bool                                depth_enabled;
+    bool                                depth_write_enabled;
+    float                               line_width;
+    float                               point_size;
+    rasterizer_t::fragment_kernel_t     fragment_kernel;
+    interpolator_layout_t               interpolator;
 };
 } // swrast
\ No newline at end of file
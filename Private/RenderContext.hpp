@@ -0,0 +1,60 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "InputAssembly.hpp"
+#include "Rasterizer.hpp"
+#include "HardwareShader.hpp"
+#include "Allocator.hpp"
+#include "PointSplat.hpp"
+#include "GeometryPipeline.hpp"
+#include "JobSystem.hpp"
+#include "CommandList.hpp"
+#include "SubmissionQueue.hpp"
+#include "ConstantRing.hpp"
+#include "PipelineState.hpp"
+#include "Compute.hpp"
+#include "Visibility.hpp"
+
+namespace swrast {
+
+
+// Everything a render needs: pipeline state, scratch memory, and workers. Contexts share nothing, so 
+// separate contexts can render at the same time, on separate threads. A context is only used by one 
+// application thread at a time.
+struct render_context_t
+{
+    // Some members are aligned to cache lines, which new does not respect before C++17.
+    static void* operator new(size_t size_bytes);
+    static void operator delete(void* ptr);
+
+    job_system_t            job_system;
+    hardware_shader_cache_t shader_cache;
+    input_assembler_t       assembler;
+    primitive_assembler_t   primitive_assembler;
+    vertex_transformation_t vertex_transformation;
+    clipper_t               clipper;
+    rasterizer_t            rasterizer;
+    point_splatter_t        point_splatter;
+    geometry_pipeline_t     geometry_pipeline;
+    compute_dispatcher_t    compute_dispatcher;
+    compute_shader_t*       compute_shader = nullptr;
+    visibility_buffer_t     visibility_buffer;
+    primitive_topology_t    bound_primitive_topology = primitive_topology_trianglelist;
+    allocator_t*            resource_allocator = nullptr;
+    front_face_t            winding_order = front_face_counter_clockwise;
+    constant_ring_t         constant_ring;
+    // Bound constant buffers, and the versions draws read. A version of 0 reads the current version of the buffer.
+    resource_t              const_buffers[SWRAST_MAX_CONST_BUFFERS] = { };
+    uintptr_t               const_buffer_versions[SWRAST_MAX_CONST_BUFFERS] = { };
+    // What the shaders of the running draw, or dispatch, see. Shader resources are bound straight into it.
+    shader_bindings_t       draw_bindings = { };
+    submission_queue_t      submission_queue;
+    // Commands recorded by the application, not handed to the submission queue yet.
+    command_buffer_t*       pending_commands = nullptr;
+    // Shaders last bound by the application, with async submission. Draws are queued with snapshots of them.
+    vertex_shader_t*        queued_vertex_shader = nullptr;
+    pixel_shader_t*         queued_pixel_shader = nullptr;
+    resource_t              queued_const_buffers[SWRAST_MAX_CONST_BUFFERS] = { };
+};
+} // swrast
@@ -0,0 +1,71 @@
+//
+#pragma once
+
+#include "Context.hpp"
+
+#include <typeinfo>
+#include <vector>
+
+namespace swrast {
+
+
+// Snapshots of shaders, in the order they were taken. Once recycled, snapshots are kept, and overwritten by
+// later snapshots of shaders of the same type, with copy_to(), so steady state recording does not allocate.
+// Snapshots of shaders without copy_to() are deleted when they are next reused.
+template<typename shader_t>
+class shader_snapshots_t
+{
+public:
+    ~shader_snapshots_t()
+    {
+        recycle();
+        for (shader_t* snapshot : m_free)
+        {
+            delete snapshot;
+        }
+    }
+
+    // Snapshot of the shader, nullptr if it can not be cloned.
+    shader_t* acquire(const shader_t& shader)
+    {
+        // Most recently recycled first, recording tends to repeat the same shaders in the same order.
+        for (size_t i = m_free.size(); i-- > 0;)
+        {
+            shader_t* snapshot = m_free[i];
+            if (typeid(*snapshot) != typeid(shader))
+            {
+                continue;
+            }
+            m_free.erase(m_free.begin() + i);
+            if (!shader.copy_to(snapshot))
+            {
+                delete snapshot;
+                break;
+            }
+            m_snapshots.push_back(snapshot);
+            return snapshot;
+        }
+        shader_t* snapshot = shader.clone();
+        if (snapshot)
+        {
+            m_snapshots.push_back(snapshot);
+        }
+        return snapshot;
+    }
+
+    // Every snapshot taken so far is done with.
+    void recycle()
+    {
+        m_free.insert(m_free.end(), m_snapshots.begin(), m_snapshots.end());
+        m_snapshots.clear();
+    }
+
+    bool empty() const { return m_snapshots.empty(); }
+    size_t size() const { return m_snapshots.size(); }
+    shader_t* operator[](size_t index) const { return m_snapshots[index]; }
+
+private:
+    std::vector<shader_t*>  m_snapshots;
+    std::vector<shader_t*>  m_free;
+};
+} // swrast
@@ -0,0 +1,125 @@
+//
+#include "SubmissionQueue.hpp"
+
+namespace swrast {
+
+
+static thread_local bool t_queue_thread = false;
+
+
+void fence_object_t::signal(uint64_t value)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_value.store(value, std::memory_order_release);
+    }
+    m_signaled.notify_all();
+}
+
+
+void fence_object_t::wait(uint64_t value)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_signaled.wait(lock, [this, value] () { return m_value.load(std::memory_order_acquire) >= value; });
+}
+
+
+error_t submission_queue_t::initialize(context_t context)
+{
+    release();
+    m_exit = false;
+    m_context = context;
+    m_thread = std::thread([this] () { thread_main(); });
+    return result_ok;
+}
+
+
+error_t submission_queue_t::release()
+{
+    if (m_thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exit = true;
+        }
+        m_wake.notify_one();
+        m_thread.join();
+    }
+    for (command_buffer_t* commands : m_free_buffers)
+    {
+        delete commands;
+    }
+    m_free_buffers.clear();
+    return result_ok;
+}
+
+
+bool submission_queue_t::is_queue_thread()
+{
+    return t_queue_thread;
+}
+
+
+command_buffer_t* submission_queue_t::acquire_buffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free_buffers.empty())
+        {
+            command_buffer_t* commands = m_free_buffers.back();
+            m_free_buffers.pop_back();
+            return commands;
+        }
+    }
+    return new command_buffer_t();
+}
+
+
+void submission_queue_t::push(command_buffer_t* commands)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(commands);
+        m_idle.store(false, std::memory_order_release);
+    }
+    m_wake.notify_one();
+}
+
+
+void submission_queue_t::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_drained.wait(lock, [this] () { return m_pending.empty() && m_idle.load(std::memory_order_acquire); });
+}
+
+
+void submission_queue_t::thread_main()
+{
+    t_queue_thread = true;
+    set_current_context(m_context);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_wake.wait(lock, [this] () { return m_exit || !m_pending.empty(); });
+        if (m_pending.empty())
+        {
+            // Exit only once everything queued has executed.
+            break;
+        }
+        command_buffer_t* commands = m_pending.front();
+        m_pending.pop_front();
+        lock.unlock();
+
+        commands->execute();
+        commands->reset();
+
+        lock.lock();
+        m_free_buffers.push_back(commands);
+        if (m_pending.empty())
+        {
+            m_idle.store(true, std::memory_order_release);
+            m_drained.notify_all();
+        }
+    }
+}
+} // swrast
@@ -0,0 +1,76 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "CommandList.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace swrast {
+
+
+// Number of recorded bytes after which queued commands are handed to the queue thread, even if it is busy.
+#define SWRAST_QUEUE_KICK_SIZE_BYTES (64 * 1024)
+
+
+// Fences track the progress of queued work. Signaling a fence sets its value, once every command 
+// queued before the signal has executed. Values are expected to increase.
+class fence_object_t
+{
+public:
+    void signal(uint64_t value);
+    // Block until the fence reaches the value.
+    void wait(uint64_t value);
+    uint64_t query() const { return m_value.load(std::memory_order_acquire); }
+
+private:
+    std::atomic<uint64_t>   m_value{ 0 };
+    std::mutex              m_mutex;
+    std::condition_variable m_signaled;
+};
+
+
+// Submission queue executes recorded command buffers, in order, on its own thread, against its context. 
+// The thread drives the pipeline, and the job system does the actual work, so the application thread is 
+// free to record the next frame in the meantime.
+class submission_queue_t
+{
+public:
+    ~submission_queue_t() { release(); }
+
+    error_t initialize(context_t context);
+    // Executes everything still queued, and stops the queue thread.
+    error_t release();
+
+    bool is_running() const { return m_thread.joinable(); }
+    // True on the queue thread, while executing commands.
+    static bool is_queue_thread();
+    // True when the queue thread has nothing left to execute.
+    bool is_idle() const { return m_idle.load(std::memory_order_acquire); }
+
+    // Get an empty command buffer to record into. Executed command buffers are recycled.
+    command_buffer_t* acquire_buffer();
+    // Queue a recorded command buffer, after every previously queued one. The queue takes ownership of it.
+    void push(command_buffer_t* commands);
+    // Block until every queued command buffer has executed.
+    void wait_idle();
+
+private:
+    void thread_main();
+
+    context_t                       m_context = 0;
+    std::thread                     m_thread;
+    std::mutex                      m_mutex;
+    std::condition_variable         m_wake;
+    std::condition_variable         m_drained;
+    std::deque<command_buffer_t*>   m_pending;
+    std::vector<command_buffer_t*>  m_free_buffers;
+    std::atomic<bool>               m_idle{ true };
+    bool                            m_exit = false;
+};
+} // swrast
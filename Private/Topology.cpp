@@ -0,0 +1,167 @@
+//
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace swrast {
+
+
+#if defined(__linux__)
+// Read a single unsigned value from a sysfs file.
+static bool read_sysfs_value(const char* path, uint32_t& value)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    const bool read = (fscanf(file, "%u", &value) == 1);
+    fclose(file);
+    return read;
+}
+
+
+// Read a sysfs cpu list, such as "0-3,8,10-11".
+static bool read_sysfs_cpu_list(const char* path, std::vector<uint32_t>& list)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return false;
+    }
+    uint32_t first = 0;
+    while (fscanf(file, "%u", &first) == 1)
+    {
+        uint32_t last = first;
+        int separator = fgetc(file);
+        if (separator == '-')
+        {
+            if (fscanf(file, "%u", &last) != 1)
+            {
+                break;
+            }
+            separator = fgetc(file);
+        }
+        for (uint32_t cpu = first; cpu <= last; ++cpu)
+        {
+            list.push_back(cpu);
+        }
+        if (separator != ',')
+        {
+            break;
+        }
+    }
+    fclose(file);
+    return true;
+}
+#endif
+
+
+error_t query_cpu_topology(std::vector<cpu_info_t>& cpus)
+{
+    cpus.clear();
+#if defined(__linux__)
+    std::vector<uint32_t> online;
+    if (!read_sysfs_cpu_list("/sys/devices/system/cpu/online", online) || online.empty())
+    {
+        return result_failed;
+    }
+    char path[128];
+    for (uint32_t cpu : online)
+    {
+        cpu_info_t info = { };
+        info.cpu = cpu;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+        read_sysfs_value(path, info.package);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+        if (!read_sysfs_value(path, info.core))
+        {
+            info.core = cpu;
+        }
+        cpus.push_back(info);
+    }
+
+    // Machines without NUMA have no node directory, and everything stays on node 0.
+    std::vector<uint32_t> nodes;
+    read_sysfs_cpu_list("/sys/devices/system/node/online", nodes);
+    for (uint32_t node : nodes)
+    {
+        std::vector<uint32_t> node_cpus;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        read_sysfs_cpu_list(path, node_cpus);
+        for (cpu_info_t& info : cpus)
+        {
+            if (std::find(node_cpus.begin(), node_cpus.end(), info.cpu) != node_cpus.end())
+            {
+                info.node = node;
+            }
+        }
+    }
+
+    // Number hardware threads within their core.
+    for (size_t i = 0; i < cpus.size(); ++i)
+    {
+        for (size_t j = 0; j < i; ++j)
+        {
+            if (cpus[j].package == cpus[i].package && cpus[j].core == cpus[i].core)
+            {
+                cpus[i].smt_index++;
+            }
+        }
+    }
+    return result_ok;
+#else
+    return result_failed;
+#endif
+}
+
+
+void select_worker_cpus(const std::vector<cpu_info_t>& cpus, uint32_t num_threads, std::vector<cpu_info_t>& selected)
+{
+    // Rank each CPU within its node, and its SMT level. Taking CPUs by rank then alternates between the nodes.
+    std::vector<std::pair<uint32_t, cpu_info_t>> ranked;
+    for (const cpu_info_t& info : cpus)
+    {
+        uint32_t rank = 0;
+        for (const cpu_info_t& other : cpus)
+        {
+            if (other.node == info.node && other.smt_index == info.smt_index && other.cpu < info.cpu)
+            {
+                rank++;
+            }
+        }
+        ranked.push_back(std::make_pair(rank, info));
+    }
+    std::sort(ranked.begin(), ranked.end(), [] (const std::pair<uint32_t, cpu_info_t>& a, const std::pair<uint32_t, cpu_info_t>& b)
+    {
+        if (a.second.smt_index != b.second.smt_index) return a.second.smt_index < b.second.smt_index;
+        if (a.first != b.first) return a.first < b.first;
+        return a.second.node < b.second.node;
+    });
+
+    selected.clear();
+    for (size_t i = 0; i < ranked.size() && selected.size() < num_threads; ++i)
+    {
+        selected.push_back(ranked[i].second);
+    }
+    std::stable_sort(selected.begin(), selected.end(), [] (const cpu_info_t& a, const cpu_info_t& b) { return a.node < b.node; });
+}
+
+
+error_t pin_current_thread(uint32_t cpu)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? result_ok : result_failed;
+#else
+    return result_failed;
+#endif
+}
+} // swrast
@@ -0,0 +1,32 @@
+//
+#pragma once
+
+#include "Context.hpp"
+
+#include <vector>
+
+namespace swrast {
+
+
+// One logical CPU, as described by the OS.
+struct cpu_info_t
+{
+    uint32_t cpu;
+    uint32_t node;
+    uint32_t package;
+    uint32_t core;
+    // 0 for the first hardware thread of a core, 1 for its first sibling, and so on.
+    uint32_t smt_index;
+};
+
+
+// Read the CPU topology from sysfs. Fails on other platforms, or if sysfs is not available.
+error_t query_cpu_topology(std::vector<cpu_info_t>& cpus);
+
+// Pick the CPUs to pin num_threads workers to. Physical cores are used before their siblings, and are 
+// spread evenly over the NUMA nodes. The result is ordered by node, so consecutive workers share a node.
+void select_worker_cpus(const std::vector<cpu_info_t>& cpus, uint32_t num_threads, std::vector<cpu_info_t>& selected);
+
+// Restrict the calling thread to a single CPU.
+error_t pin_current_thread(uint32_t cpu);
+} // swrast
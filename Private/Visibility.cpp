@@ -0,0 +1,167 @@
+//
+#include "Visibility.hpp"
+
+#include <cstring>
+
+namespace swrast {
+
+
+void visibility_buffer_t::release()
+{
+    release_snapshots();
+    for (memory_pool_t* block : m_blocks)
+    {
+        delete block;
+    }
+    m_blocks.clear();
+    m_block = 0;
+    m_offset = 0;
+    m_draws.clear();
+    m_triangles.clear();
+    m_ids.release();
+    m_width = 0;
+    m_height = 0;
+    m_array_size = 0;
+    m_active = false;
+}
+
+
+void visibility_buffer_t::release_snapshots()
+{
+    for (pixel_shader_t* snapshot : m_pixel_snapshots)
+    {
+        delete snapshot;
+    }
+    m_pixel_snapshots.clear();
+}
+
+
+void visibility_buffer_t::clear_ids()
+{
+    if (m_ids.get_base_address())
+    {
+        memset((void*)m_ids.get_base_address(), 0xFF, (size_t)m_width * m_height * m_array_size * sizeof(uint32_t));
+    }
+}
+
+
+void visibility_buffer_t::prepare(uint32_t width, uint32_t height, uint32_t array_size)
+{
+    if (width == m_width && height == m_height && array_size == m_array_size)
+    {
+        return;
+    }
+    m_width = width;
+    m_height = height;
+    m_array_size = array_size;
+    m_ids.preallocate((uint64_t)width * height * array_size * sizeof(uint32_t));
+    clear_ids();
+}
+
+
+uintptr_t visibility_buffer_t::copy(uintptr_t source, uint64_t size_bytes)
+{
+    size_bytes = (size_bytes + 15) & ~15ull;
+    while (m_block < m_blocks.size() && m_offset + size_bytes > m_blocks[m_block]->get_memory_size_bytes())
+    {
+        ++m_block;
+        m_offset = 0;
+    }
+    if (m_block == m_blocks.size())
+    {
+        memory_pool_t* block = new memory_pool_t();
+        block->preallocate(size_bytes > SWRAST_VISIBILITY_BLOCK_SIZE_BYTES ? size_bytes : SWRAST_VISIBILITY_BLOCK_SIZE_BYTES);
+        m_blocks.push_back(block);
+        m_offset = 0;
+    }
+    const uintptr_t destination = m_blocks[m_block]->get_base_address() + m_offset;
+    m_offset += size_bytes;
+    memcpy((void*)destination, (const void*)source, (size_t)size_bytes);
+    return destination;
+}
+
+
+bool visibility_buffer_t::begin_draw(pixel_shader_t* pixel_shader, const shader_bindings_t& bindings, const uint32_t* const_buffer_sizes,
+    const interpolator_layout_t& interpolator)
+{
+    if (m_draws.size() == SWRAST_VISIBILITY_MAX_DRAWS)
+    {
+        return false;
+    }
+    visibility_draw_t draw;
+    draw.pixel_shader = pixel_shader;
+    pixel_shader_t* snapshot = pixel_shader ? pixel_shader->clone() : nullptr;
+    if (snapshot)
+    {
+        m_pixel_snapshots.push_back(snapshot);
+        draw.pixel_shader = snapshot;
+    }
+    draw.bindings = bindings;
+    for (uint32_t slot = 0; slot < SWRAST_MAX_CONST_BUFFERS; ++slot)
+    {
+        if (bindings.const_buffers[slot] && const_buffer_sizes[slot])
+        {
+            draw.bindings.const_buffers[slot] = (const void*)copy((uintptr_t)bindings.const_buffers[slot], const_buffer_sizes[slot]);
+        }
+    }
+    draw.interpolator = interpolator;
+    draw.first_triangle = (uint32_t)m_triangles.size();
+    draw.num_triangles = 0;
+    m_draws.push_back(draw);
+    return true;
+}
+
+
+bool visibility_buffer_t::reserve_triangles(uint32_t num_triangles)
+{
+    const visibility_draw_t& draw = m_draws.back();
+    if (draw.num_triangles + (uint64_t)num_triangles <= SWRAST_VISIBILITY_MAX_TRIANGLES)
+    {
+        return true;
+    }
+    if (m_draws.size() == SWRAST_VISIBILITY_MAX_DRAWS)
+    {
+        return false;
+    }
+    // Carry on with the same state, under the next draw id.
+    visibility_draw_t next = draw;
+    next.first_triangle = (uint32_t)m_triangles.size();
+    next.num_triangles = 0;
+    m_draws.push_back(next);
+    return true;
+}
+
+
+uint32_t visibility_buffer_t::add_triangle(const visibility_triangle_t& triangle)
+{
+    visibility_draw_t& draw = m_draws.back();
+    const uint32_t visibility_id = ((uint32_t)(m_draws.size() - 1) << SWRAST_VISIBILITY_TRIANGLE_BITS) | draw.num_triangles;
+    m_triangles.push_back(triangle);
+    ++draw.num_triangles;
+    return visibility_id;
+}
+
+
+void visibility_buffer_t::reset()
+{
+    release_snapshots();
+    m_draws.clear();
+    m_triangles.clear();
+    m_block = 0;
+    m_offset = 0;
+    clear_ids();
+}
+
+
+void visibility_buffer_t::restart_draw()
+{
+    // The snapshot, and the constants, of the current draw are still in use, so memory is not reused yet.
+    visibility_draw_t draw = m_draws.back();
+    draw.first_triangle = 0;
+    draw.num_triangles = 0;
+    m_draws.clear();
+    m_draws.push_back(draw);
+    m_triangles.clear();
+    clear_ids();
+}
+} // swrast
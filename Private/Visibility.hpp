@@ -0,0 +1,114 @@
+//
+#pragma once
+
+#include "Context.hpp"
+#include "Memory.hpp"
+#include "Rasterizer.hpp"
+
+#include <vector>
+
+namespace swrast {
+
+
+// Visibility ids pack the draw, in the high bits, with the triangle of the draw. Draws with more triangles
+// than fit take more than one draw id.
+#define SWRAST_VISIBILITY_DRAW_BITS 12
+#define SWRAST_VISIBILITY_TRIANGLE_BITS (32 - SWRAST_VISIBILITY_DRAW_BITS)
+#define SWRAST_VISIBILITY_MAX_TRIANGLES (1u << SWRAST_VISIBILITY_TRIANGLE_BITS)
+// The last draw id is never handed out, so no id is SWRAST_VISIBILITY_EMPTY.
+#define SWRAST_VISIBILITY_MAX_DRAWS ((1u << SWRAST_VISIBILITY_DRAW_BITS) - 1)
+#define SWRAST_VISIBILITY_EMPTY 0xFFFFFFFFu
+// Size of the blocks vertices and constants of the pass are copied into.
+#define SWRAST_VISIBILITY_BLOCK_SIZE_BYTES SWRAST_MEM_1MB(1)
+// Number of visible pixels shaded by a single job, when resolving.
+#define SWRAST_VISIBILITY_PIXELS_PER_JOB 1024
+
+
+// What the pixel shader of a draw runs with, once resolved. Constant buffers point at copies made when the
+// draw was issued.
+struct visibility_draw_t
+{
+    pixel_shader_t*         pixel_shader;
+    shader_bindings_t       bindings;
+    interpolator_layout_t   interpolator;
+    uint32_t                first_triangle;
+    uint32_t                num_triangles;
+};
+
+
+// Triangle of the pass, in screen space, with the winding it was rasterized with. Vertices point at copies
+// of the shaded vertices, made when the triangle was rasterized.
+struct visibility_triangle_t
+{
+    float4_t        screen_positions[3];
+    uintptr_t       attribs[3];
+    float           area;
+    front_face_t    winding_order;
+};
+
+
+// Visibility pass, between begin and end of the pass. Holds the visibility id of every pixel of the render
+// target, and every draw and triangle an id may refer to. The shaded vertices of the draws are kept for
+// the whole pass, so the pass holds onto memory in proportion to the geometry drawn.
+class visibility_buffer_t
+{
+public:
+    ~visibility_buffer_t() { release(); }
+
+    void release();
+
+    bool is_active() const { return m_active; }
+    void set_active(bool active) { m_active = active; }
+    bool is_empty() const { return m_draws.empty(); }
+
+    // Size the ids to the render target. Ids are reallocated, and cleared, only when the size changes.
+    void prepare(uint32_t width, uint32_t height, uint32_t array_size);
+
+    // Start a draw, shaded with the given pixel shader and bindings. Shaders are snapshot with clone(), where
+    // they support it. Constant buffers, of the given sizes, are copied. Returns false if the pass is out of
+    // draw ids, and needs to be resolved first.
+    bool begin_draw(pixel_shader_t* pixel_shader, const shader_bindings_t& bindings, const uint32_t* const_buffer_sizes,
+        const interpolator_layout_t& interpolator);
+    // Make room for more triangles in the current draw. Returns false if the pass is out of draw ids, and
+    // needs to be resolved, and restarted, first.
+    bool reserve_triangles(uint32_t num_triangles);
+    // Add a triangle to the current draw, returns its visibility id. Room has to be reserved first.
+    uint32_t add_triangle(const visibility_triangle_t& triangle);
+    // Copy memory into the pass, where it stays until the pass is reset. 16 byte aligned.
+    uintptr_t copy(uintptr_t source, uint64_t size_bytes);
+
+    // Drop every draw, and clear the ids.
+    void reset();
+    // Drop every draw, but the current one, which starts over without triangles. Clear the ids.
+    void restart_draw();
+
+    uint32_t* get_ids() const { return (uint32_t*)m_ids.get_base_address(); }
+    uint32_t get_width() const { return m_width; }
+    uint32_t get_height() const { return m_height; }
+    uint32_t get_array_size() const { return m_array_size; }
+    uint32_t get_num_draws() const { return (uint32_t)m_draws.size(); }
+    const visibility_draw_t& get_draw(uint32_t draw_id) const { return m_draws[draw_id]; }
+    const visibility_triangle_t& get_triangle(uint32_t visibility_id) const
+    {
+        const visibility_draw_t& draw = m_draws[visibility_id >> SWRAST_VISIBILITY_TRIANGLE_BITS];
+        return m_triangles[draw.first_triangle + (visibility_id & (SWRAST_VISIBILITY_MAX_TRIANGLES - 1))];
+    }
+
+private:
+    void clear_ids();
+    void release_snapshots();
+
+    bool                                m_active = false;
+    memory_pool_t                       m_ids;
+    uint32_t                            m_width = 0;
+    uint32_t                            m_height = 0;
+    uint32_t                            m_array_size = 0;
+    std::vector<visibility_draw_t>      m_draws;
+    std::vector<visibility_triangle_t>  m_triangles;
+    std::vector<pixel_shader_t*>        m_pixel_snapshots;
+    // Blocks memory is copied into, one after the other. Reused once the pass is reset.
+    std::vector<memory_pool_t*>         m_blocks;
+    uint32_t                            m_block = 0;
+    uint64_t                            m_offset = 0;
+};
+} // swrast
@@ -7,12 +7,29 @@
 namespace swrast {
 
 SW_EXPORT_DLL error_t       initialize();
+// Same as above, with an explicit number of worker threads. The calling thread also runs work, 0 runs everything on it.
+SW_EXPORT_DLL error_t       initialize(uint32_t num_worker_threads);
+SW_EXPORT_DLL error_t       initialize(const context_desc_t& desc);
 SW_EXPORT_DLL error_t       destroy();
 
+// Contexts own their pipeline state, scratch memory and worker threads, so independent renders can run at the 
+// same time, each on its own thread and context. Every other call applies to the current context of the calling 
+// thread, which is the default context, created by initialize(), unless set otherwise. Resources and input 
+// layouts may be used by any context.
+SW_EXPORT_DLL context_t     create_context(const context_desc_t& desc);
+SW_EXPORT_DLL error_t       destroy_context(context_t context);
+// 0 goes back to the default context.
+SW_EXPORT_DLL error_t       set_current_context(context_t context);
+SW_EXPORT_DLL context_t     get_current_context();
+
 SW_EXPORT_DLL resource_t    allocate_resource(const resource_desc_t& desc);
 SW_EXPORT_DLL error_t       release_resource(resource_t resource);
 
 SW_EXPORT_DLL error_t       set_viewports(uint32_t count, viewport_t* viewports);
+// Multi-view rendering. The vertex shader is invoked once per vertex and outputs one clip position per view, 
+// each view is then rasterized into its own viewport and/or render target array slice. A view count of 1 disables it.
+// Without locations, view i is rasterized to slice i in the first viewport.
+SW_EXPORT_DLL error_t       set_view_instancing(uint32_t view_count, view_instance_location_t* locations);
 
 SW_EXPORT_DLL sampler_t     create_sampler(const sampler_desc_t& desc);
 SW_EXPORT_DLL error_t       destroy_sampler(sampler_t sampler);
@@ -24,22 +41,59 @@ SW_EXPORT_DLL error_t       clear_render_target(uint32_t slot, const rect_t& rec
 SW_EXPORT_DLL error_t       clear_depth_stencil(float depth, const rect_t& rect);
 
 SW_EXPORT_DLL error_t       bind_vertex_buffers(uint32_t num_vbs, resource_t* vbs);
-SW_EXPORT_DLL error_t       bind_index_buffer(resource_t ib);
+// Index buffers can be format_r16_uint or format_r32_uint.
+SW_EXPORT_DLL error_t       bind_index_buffer(resource_t ib, format_t format = format_r32_uint);
 
 SW_EXPORT_DLL error_t       draw_instanced(uint32_t num_vertices, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
 SW_EXPORT_DLL error_t       draw_indexed_instanced(uint32_t num_indices, uint32_t num_instances, uint32_t first_index, uint32_t vertex_offset, uint32_t first_instance);
+// Multiple indexed draws, with their arguments read from a buffer resource. args holds count 
+// draw_indexed_indirect_args_t records, stride bytes apart. Every draw uses the state bound at the time of the call.
+// Arguments are read when the draws execute, so with command lists, or async submission, keep them unchanged
+// until then. Draws without indices or instances are skipped.
+SW_EXPORT_DLL error_t       draw_indexed_indirect(resource_t args, uint32_t count, uint32_t stride);
+
+// High throughput point cloud rendering. Skips the vertex shader, triangle setup, and pixel shader entirely. 
+// Each point covers one pixel, and the closest point (by the bound depth compare op) wins.
+SW_EXPORT_DLL error_t       draw_point_splats(const point_splat_desc_t& desc);
+
+// Visibility buffer rendering, for scenes with a lot of overdraw. Within the pass, triangle draws only depth test, 
+// and keep the draw and triangle visible at each pixel. end_visibility_pass() then runs the pixel shader of each 
+// draw once per pixel it is visible at, with the constants, shader resources and shader it was drawn with. 
+// Pixel shaders that clone() are snapshot, others have to stay unchanged until the pass ends. Only triangles can 
+// be drawn. Clears, render target binds, point splats and dispatches shade what was drawn so far first.
+// Shaded vertices are kept until then, so memory grows with the geometry drawn in the pass.
+SW_EXPORT_DLL error_t       begin_visibility_pass();
+SW_EXPORT_DLL error_t       end_visibility_pass();
 
 SW_EXPORT_DLL shader_t      create_shader(shader_type_t type, void* src_code, uint32_t size_bytes);
 SW_EXPORT_DLL error_t       destroy_shader(shader_t shader);
 
+// Shader resources and constant buffers are bound for every shader stage. Shaders read them by slot.
 SW_EXPORT_DLL error_t       bind_shader_resource(uint32_t slot, resource_t resource);
 SW_EXPORT_DLL error_t       bind_const_buffer(uint32_t slot, resource_t resource);
+// Unordered access views are read and written by shaders of every stage, see i_shader_t::image_load(). The 
+// resource needs usage_unordered_access, and a format shaders can store. Writes are visible once the work 
+// is done, to the next draw or dispatch, and to map_resource().
+SW_EXPORT_DLL error_t       bind_unordered_access(uint32_t slot, resource_t resource);
 
 SW_EXPORT_DLL error_t       bind_vertex_shader(vertex_shader_t* vs);
 SW_EXPORT_DLL error_t       bind_pixel_shader(pixel_shader_t* ps);
+SW_EXPORT_DLL error_t       bind_compute_shader(compute_shader_t* cs);
+
+// Run groups_x * groups_y * groups_z groups of the bound compute shader, spread across the workers. Returns once 
+// every group is done, or right away with async submission, like draws. The shader sees the bound constant 
+// buffers and shader resources. It runs in place, without a snapshot, so leave it untouched until the dispatch is done.
+SW_EXPORT_DLL error_t       dispatch(uint32_t groups_x, uint32_t groups_y, uint32_t groups_z);
 
+// Waits for every queued draw and clear to complete, with async submission.
 SW_EXPORT_DLL error_t       map_resource(void** ptr, resource_t resource);
 SW_EXPORT_DLL error_t       unmap_resource(resource_t resource);
+// Constant buffers only. Returns new memory for the buffer, with undefined contents, and does not wait. Draws 
+// recorded or queued before keep reading the previous contents, draws after read the new ones. The memory 
+// comes from a ring of the current context, and is recycled once no buffer or queued draw uses it. Release 
+// the buffer before destroying that context. Threads recording command lists may map with discard at the same 
+// time, draws recorded while another thread discards the same buffer read either version.
+SW_EXPORT_DLL error_t       map_resource_discard(void** ptr, resource_t resource);
 
 SW_EXPORT_DLL error_t       enable_depth(bool enable);
 SW_EXPORT_DLL error_t       enable_depth_write(bool enable);
@@ -47,9 +101,81 @@ SW_EXPORT_DLL error_t       enable_depth_write(bool enable);
 SW_EXPORT_DLL error_t       set_cull_mode(cull_mode_t cull_mode);
 
 SW_EXPORT_DLL error_t       set_primitive_topology(primitive_topology_t primitive_topology);
+// Primitive restart cuts strips and fans, when the index 0xFFFF (r16) or 0xFFFFFFFF (r32) is found in the index buffer.
+SW_EXPORT_DLL error_t       enable_primitive_restart(bool enable);
 SW_EXPORT_DLL error_t       set_front_face(front_face_t front_face);
+// Width of lines, and size of points, in pixels.
+SW_EXPORT_DLL error_t       set_line_width(float width);
+SW_EXPORT_DLL error_t       set_point_size(float size);
 SW_EXPORT_DLL error_t       set_depth_compare(compare_op_t compare_op);
 
+// Input layouts and pipeline states are deduplicated, creating one identical to an existing one returns the same 
+// handle. Each create must be matched by a destroy, the object is freed with the last one.
 SW_EXPORT_DLL input_layout_t create_input_layout(uint32_t num_elements, input_element_desc* descs);
+SW_EXPORT_DLL error_t        destroy_input_layout(input_layout_t layout);
 SW_EXPORT_DLL error_t        set_input_layout(input_layout_t layout);
+
+// Pipeline states bundle the shaders, input layout, and fixed function state of draws. Everything is validated 
+// and derived once, at creation, so binding one replaces the matching individual calls at a fraction of their cost. 
+// Returns 0 if the description is invalid. Shaders and the input layout must stay alive as long as the pipeline state.
+SW_EXPORT_DLL pipeline_state_t create_pipeline_state(const pipeline_state_desc_t& desc);
+SW_EXPORT_DLL error_t        destroy_pipeline_state(pipeline_state_t pipeline_state);
+SW_EXPORT_DLL error_t        bind_pipeline_state(pipeline_state_t pipeline_state);
+
+// Command lists record state changes and draws into a compact buffer, instead of executing them. Recording does 
+// not touch the context, so each thread can record its own command lists. Pointers passed while recording 
+// (viewports, resources...) are copied, shaders and resources themselves must stay alive until submitted.
+SW_EXPORT_DLL command_list_t create_command_list();
+SW_EXPORT_DLL error_t        destroy_command_list(command_list_t command_list);
+// Drop every recorded command, keeping the memory for the next recording.
+SW_EXPORT_DLL error_t        reset_command_list(command_list_t command_list);
+// Execute command lists in order, on the calling thread. Command lists stay recorded, and can be submitted again.
+// With async submission, they are copied to the queue instead.
+SW_EXPORT_DLL error_t        submit(uint32_t num_command_lists, command_list_t* command_lists);
+// Hand every queued command over to the submission queue thread. Only needed with async submission, 
+// when nothing else (fences, map_resource()...) will.
+SW_EXPORT_DLL error_t        flush();
+
+// Fences report progress of the submission queue. A signal sets the fence value, once everything queued 
+// before it is done. Without async submission, signals take effect immediately.
+SW_EXPORT_DLL fence_t        create_fence();
+SW_EXPORT_DLL error_t        destroy_fence(fence_t fence);
+SW_EXPORT_DLL error_t        signal_fence(fence_t fence, uint64_t value);
+// Block until the fence reaches the value.
+SW_EXPORT_DLL error_t        wait_fence(fence_t fence, uint64_t value);
+SW_EXPORT_DLL uint64_t       query_fence(fence_t fence);
+
+SW_EXPORT_DLL error_t        cmd_set_viewports(command_list_t command_list, uint32_t count, viewport_t* viewports);
+SW_EXPORT_DLL error_t        cmd_set_view_instancing(command_list_t command_list, uint32_t view_count, view_instance_location_t* locations);
+SW_EXPORT_DLL error_t        cmd_bind_render_targets(command_list_t command_list, uint32_t num_rtvs, resource_t* rtvs, resource_t dsv);
+SW_EXPORT_DLL error_t        cmd_bind_depth_stencil(command_list_t command_list, resource_t ds);
+SW_EXPORT_DLL error_t        cmd_clear_render_target(command_list_t command_list, uint32_t slot, const rect_t& rect, float* rgba);
+SW_EXPORT_DLL error_t        cmd_clear_depth_stencil(command_list_t command_list, float depth, const rect_t& rect);
+SW_EXPORT_DLL error_t        cmd_bind_vertex_buffers(command_list_t command_list, uint32_t num_vbs, resource_t* vbs);
+SW_EXPORT_DLL error_t        cmd_bind_index_buffer(command_list_t command_list, resource_t ib, format_t format = format_r32_uint);
+SW_EXPORT_DLL error_t        cmd_draw_instanced(command_list_t command_list, uint32_t num_vertices, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
+SW_EXPORT_DLL error_t        cmd_draw_indexed_instanced(command_list_t command_list, uint32_t num_indices, uint32_t num_instances, uint32_t first_index, uint32_t vertex_offset, uint32_t first_instance);
+SW_EXPORT_DLL error_t        cmd_draw_indexed_indirect(command_list_t command_list, resource_t args, uint32_t count, uint32_t stride);
+SW_EXPORT_DLL error_t        cmd_draw_point_splats(command_list_t command_list, const point_splat_desc_t& desc);
+SW_EXPORT_DLL error_t        cmd_begin_visibility_pass(command_list_t command_list);
+SW_EXPORT_DLL error_t        cmd_end_visibility_pass(command_list_t command_list);
+SW_EXPORT_DLL error_t        cmd_bind_vertex_shader(command_list_t command_list, vertex_shader_t* vs);
+SW_EXPORT_DLL error_t        cmd_bind_pixel_shader(command_list_t command_list, pixel_shader_t* ps);
+SW_EXPORT_DLL error_t        cmd_bind_compute_shader(command_list_t command_list, compute_shader_t* cs);
+SW_EXPORT_DLL error_t        cmd_dispatch(command_list_t command_list, uint32_t groups_x, uint32_t groups_y, uint32_t groups_z);
+SW_EXPORT_DLL error_t        cmd_bind_shader_resource(command_list_t command_list, uint32_t slot, resource_t resource);
+SW_EXPORT_DLL error_t        cmd_bind_const_buffer(command_list_t command_list, uint32_t slot, resource_t resource);
+SW_EXPORT_DLL error_t        cmd_bind_unordered_access(command_list_t command_list, uint32_t slot, resource_t resource);
+SW_EXPORT_DLL error_t        cmd_enable_depth(command_list_t command_list, bool enable);
+SW_EXPORT_DLL error_t        cmd_enable_depth_write(command_list_t command_list, bool enable);
+SW_EXPORT_DLL error_t        cmd_set_cull_mode(command_list_t command_list, cull_mode_t cull_mode);
+SW_EXPORT_DLL error_t        cmd_set_primitive_topology(command_list_t command_list, primitive_topology_t primitive_topology);
+SW_EXPORT_DLL error_t        cmd_enable_primitive_restart(command_list_t command_list, bool enable);
+SW_EXPORT_DLL error_t        cmd_set_front_face(command_list_t command_list, front_face_t front_face);
+SW_EXPORT_DLL error_t        cmd_set_line_width(command_list_t command_list, float width);
+SW_EXPORT_DLL error_t        cmd_set_point_size(command_list_t command_list, float size);
+SW_EXPORT_DLL error_t        cmd_set_depth_compare(command_list_t command_list, compare_op_t compare_op);
+SW_EXPORT_DLL error_t        cmd_set_input_layout(command_list_t command_list, input_layout_t layout);
+SW_EXPORT_DLL error_t        cmd_bind_pipeline_state(command_list_t command_list, pipeline_state_t pipeline_state);
+SW_EXPORT_DLL error_t        cmd_signal_fence(command_list_t command_list, fence_t fence, uint64_t value);
 } // SWRast
\ No newline at end of file
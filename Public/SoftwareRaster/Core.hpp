@@ -15,6 +15,14 @@
 namespace swrast {
 
 #define SWRAST_MAX_VARYING_SIZE_BYTES 128
+#define SWRAST_MAX_VIEWPORTS 8
+#define SWRAST_MAX_VIEW_INSTANCES 8
+#define SWRAST_MAX_CONST_BUFFERS 8
+#define SWRAST_MAX_SHADER_RESOURCES 16
+#define SWRAST_MAX_UNORDERED_ACCESS_VIEWS 8
+#define SWRAST_MAX_COMPUTE_GROUP_THREADS 1024
+#define SWRAST_MAX_GROUP_SHARED_SIZE_BYTES (32 * 1024)
+#define SWRAST_INVALID_OFFSET 0xFFFFFFFF
 
 typedef uint32_t error_t;
 typedef uint64_t resource_t;
@@ -22,6 +30,10 @@ typedef uint32_t sampler_t;
 typedef uint32_t uint;
 typedef uint32_t view_t;
 typedef uint64_t input_layout_t;
+typedef uint64_t command_list_t;
+typedef uint64_t fence_t;
+typedef uint64_t context_t;
+typedef uint64_t pipeline_state_t;
 
 enum error_result_t
 {
@@ -66,6 +78,9 @@ enum primitive_topology_t
     primitive_topology_trianglelist,
     primitive_topology_points,
     primitive_topology_lines,
+    primitive_topology_trianglestrip,
+    primitive_topology_trianglefan,
+    primitive_topology_linestrip,
 };
 
 
@@ -81,6 +96,16 @@ enum format_t
     format_r11g11b10_float,
     format_r32g32b32_float,
     format_r32g32_float,
+    format_r16_uint,
+    format_r32_uint,
+    format_r16_float,
+    format_r16g16_snorm,
+    format_r16g16b16a16_snorm,
+    format_r16g16_unorm,
+    format_r16g16b16a16_unorm,
+    format_r10g10b10a2_unorm,
+    // Unit vector, octahedral encoded into 2 snorm16 components. Decodes to 3 floats. Vertex input only.
+    format_r16g16_snorm_octahedral,
 };
 
 
@@ -116,6 +141,13 @@ struct viewport_t
     float far;
 };
 
+// Where a view is rasterized to, when rendering with multiple views.
+struct view_instance_location_t
+{
+    uint32_t viewport_array_index;
+    uint32_t render_target_array_index;
+};
+
 struct rect_t
 {
     uint32_t x;
@@ -156,11 +188,24 @@ enum cull_mode_t
 };
 
 
+enum input_classification_t
+{
+    input_classification_per_vertex,
+    input_classification_per_instance
+};
+
+
+// Elements are decoded into the vertex shader's input record in declaration order, with every 
+// component expanded to 32 bits (float for float and norm formats, uint32 for uint formats).
 struct input_element_desc
 {
     format_t format;
     uint32_t input_slot;
     uint32_t offset;
+    // Per instance slots advance once every instance_data_step_rate instances. 
+    // Classification and step rate must be the same for all elements within the same input slot.
+    input_classification_t input_classification;
+    uint32_t instance_data_step_rate;
 };
 
 
@@ -190,5 +235,77 @@ struct sampler_desc_t
 };
 
 
+// Arguments of a single draw of draw_indexed_indirect(), as they are laid out in the argument buffer.
+struct draw_indexed_indirect_args_t
+{
+    uint32_t num_indices;
+    uint32_t num_instances;
+    uint32_t first_index;
+    uint32_t vertex_offset;
+    uint32_t first_instance;
+};
+
+
+// Point cloud, splatted directly into the bound render target 0, and depth stencil, with viewport 0.
+struct point_splat_desc_t
+{
+    // float3_t object space positions.
+    resource_t  positions;
+    uint32_t    position_stride_bytes;
+    // r8g8b8a8 packed colors. Points are white if 0.
+    resource_t  colors;
+    uint32_t    color_stride_bytes;
+    uint32_t    first_point;
+    uint32_t    num_points;
+    // Object to clip space transform.
+    float4x4_t  view_projection;
+};
+
+
+// Placement of the worker threads, and of the memory they render to.
+enum thread_affinity_t
+{
+    thread_affinity_none = (0),
+    // Pin each worker to its own core, following the CPU topology. Linux only, ignored elsewhere.
+    thread_affinity_pin_workers = (1 << 0),
+    // Split render targets and depth buffers into bands of rows, each first touched and rasterized by the same 
+    // worker, so their memory ends up on the NUMA node of that worker. Best combined with pinned workers.
+    thread_affinity_numa_local_targets = (1 << 1)
+};
+
+
+struct context_desc_t
+{
+    // The calling thread also runs work, 0 runs everything on it.
+    uint32_t    num_worker_threads;
+    // thread_affinity_t flags.
+    uint32_t    thread_affinity;
+    // Draws, clears and state changes are queued, and executed on a separate thread. Calls return right away, 
+    // use fences, or map_resource(), to know when the work is done.
+    bool        async_submission;
+};
+
+
+class vertex_shader_t;
+class pixel_shader_t;
+
+// Shaders, input layout, and every fixed function state a draw depends on, besides bindings and viewports.
+struct pipeline_state_desc_t
+{
+    vertex_shader_t*        vertex_shader;
+    pixel_shader_t*         pixel_shader;
+    input_layout_t          input_layout;
+    primitive_topology_t    primitive_topology;
+    bool                    primitive_restart_enable;
+    cull_mode_t             cull_mode;
+    front_face_t            front_face;
+    float                   line_width;
+    float                   point_size;
+    bool                    depth_enable;
+    bool                    depth_write_enable;
+    compare_op_t            depth_compare;
+};
+
+
 SW_EXPORT_DLL size_t format_size_bytes(format_t format);
 } // swrast
\ No newline at end of file
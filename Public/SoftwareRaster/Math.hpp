@@ -201,6 +201,29 @@ private:
 };
 
 
+// 8 wide float, each lane belongs to a different element. Used for structure of arrays processing, 
+// such as batched vertex shading. Requires AVX.
+class vec8_simd_t
+{
+public:
+    vec8_simd_t(float scalar = 0.0f)
+        : v(_mm256_set1_ps(scalar)) { }
+
+    vec8_simd_t(__m256 v)
+        : v(v) { }
+
+    vec8_simd_t operator+(const vec8_simd_t& o) const { return vec8_simd_t(_mm256_add_ps(v, o.v)); }
+    vec8_simd_t operator-(const vec8_simd_t& o) const { return vec8_simd_t(_mm256_sub_ps(v, o.v)); }
+    vec8_simd_t operator*(const vec8_simd_t& o) const { return vec8_simd_t(_mm256_mul_ps(v, o.v)); }
+    vec8_simd_t operator/(const vec8_simd_t& o) const { return vec8_simd_t(_mm256_div_ps(v, o.v)); }
+    vec8_simd_t operator*(float scalar) const { return vec8_simd_t(_mm256_mul_ps(v, _mm256_set1_ps(scalar))); }
+
+    __m256 v;
+};
+
+typedef vec8_simd_t float8_t;
+
+
 template<typename type>
 vec3_t<type> operator+(type scalar, const vec3_t<type>& rh)
 {
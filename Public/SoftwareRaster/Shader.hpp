@@ -11,9 +11,66 @@ namespace swrast {
 
 typedef uint32_t shader_t;
 
-struct i_shader_t
+// Constant buffers, shader resources and unordered access views bound to the context, as seen by the shaders 
+// of a draw. Constant buffers point at the version of their contents the draw was recorded with.
+struct shader_bindings_t
+{
+    const void* const_buffers[SWRAST_MAX_CONST_BUFFERS];
+    resource_t  shader_resources[SWRAST_MAX_SHADER_RESOURCES];
+    resource_t  unordered_access[SWRAST_MAX_UNORDERED_ACCESS_VIEWS];
+};
+
+
+struct SW_EXPORT_DLL i_shader_t
 {
     shader_t id;
+
+    // Bindings of the running draw, set by the pipeline.
+    void set_bindings(const shader_bindings_t* bindings) { this->bindings = bindings; }
+
+protected:
+    // Contents of the constant buffer bound to the slot.
+    template<typename type>
+    const type& constants(uint32_t slot) const { return *(const type*)bindings->const_buffers[slot]; }
+
+    resource_t shader_resource(uint32_t slot) const { return bindings->shader_resources[slot]; }
+
+    // Unordered access views, written from any stage. Elements are addressed by coord, in elements of the format 
+    // of the resource, mip 0 only. Buffers are a row of width elements. Loads outside the resource return 0, 
+    // stores, and atomics, outside of it are dropped.
+    // Pixel shaders of separate tiles, and compute groups, run at the same time on separate workers, in no 
+    // particular order. Plain stores to the same element race, use the atomics when threads may collide.
+    float4_t image_load(uint32_t slot, const uint3_t& coord) const;
+    void image_store(uint32_t slot, const uint3_t& coord, const float4_t& value) const;
+    uint3_t image_size(uint32_t slot) const;
+
+    // Value of a format_r32_uint, or format_r16_uint, element, as is. image_load returns them as floats, exact only up 
+    // to 2^24. Other formats return 0. Safe to use on elements other threads run atomics on.
+    uint32_t image_load_uint(uint32_t slot, const uint3_t& coord) const;
+    // Atomics on format_r32_uint elements, returning the value before the operation. Other formats do nothing, and return 0.
+    uint32_t atomic_add(uint32_t slot, const uint3_t& coord, uint32_t value) const;
+    uint32_t atomic_min(uint32_t slot, const uint3_t& coord, uint32_t value) const;
+    uint32_t atomic_max(uint32_t slot, const uint3_t& coord, uint32_t value) const;
+    // Stores value, only if the element equals compare.
+    uint32_t atomic_compare_exchange(uint32_t slot, const uint3_t& coord, uint32_t compare, uint32_t value) const;
+
+    const shader_bindings_t* bindings = nullptr;
+};
+
+
+// Number of vertices in a batch, for batched vertex shading.
+#define SWRAST_VERTEX_BATCH_SIZE 8
+
+// Structure of arrays batch of vertices. Every 32 bit value of the input record, and output vertex, is 
+// stored as a float8_t, with one lane per vertex. in[i] holds the i-th value of all input records, and 
+// out[i] must be written with the i-th value of all output vertices. Lanes past count are ignored.
+struct vertex_batch_t
+{
+    uint32_t        count;
+    uint32_t        vert_ids[SWRAST_VERTEX_BATCH_SIZE];
+    uint32_t        instance_id;
+    const float8_t* in;
+    float8_t*       out;
 };
 
 
@@ -27,10 +84,35 @@ public:
 
     // Execution handle for the shader.
     // REQUIRED: output a vertex, with at least one position in clip space.
-    virtual void execute(uintptr_t in_vertex_ptr, uintptr_t out_vertex, uint32_t vert_id) = 0;
+    // in_vertex_ptr holds the input of every bound input slot, packed one after the other in slot order. 
+    // instance_id is the instance being drawn, starting at 0 for every draw.
+    // Called from several threads at once, so it must not modify the shader.
+    virtual void execute(uintptr_t in_vertex_ptr, uintptr_t out_vertex, uint32_t vert_id, uint32_t instance_id) = 0;
+
+    // Optional batched execution handle. Shades SWRAST_VERTEX_BATCH_SIZE vertices at a time, in structure of arrays form.
+    // Only called if the shader enables it with set_batch_execution(true).
+    virtual void execute_batch(vertex_batch_t&) { }
+
+    // Optional copy of the shader, constants included. Draws recorded into command lists, or queued with async 
+    // submission, run with a snapshot of the bound shaders taken when the draw was recorded, so the application 
+    // may change the constants right after. Shaders returning nullptr are used in place, and must be left 
+    // untouched until the draw is done.
+    virtual vertex_shader_t* clone() const { return nullptr; }
+    // Optional, copy the shader, constants included, over a snapshot clone() made of a shader of the same type.
+    // Lets snapshots be reused from draw to draw, instead of cloned for each. Returns false if not supported.
+    virtual bool copy_to(vertex_shader_t*) const { return false; }
+
+    bool supports_batch_execution() const { return batch_execution; }
 
     uint32_t get_out_vertex_stride() const { return out_vertex_stride_bytes; }
     uint32_t get_out_pos_offset_bytes() const { return out_pos_offset_bytes; }
+    uint32_t get_out_viewport_index_offset_bytes() const { return out_viewport_index_offset_bytes; }
+    uint32_t get_out_render_target_array_index_offset_bytes() const { return out_render_target_array_index_offset_bytes; }
+    uint32_t get_out_view_pos_offset_bytes() const { return out_view_pos_offset_bytes; }
+
+    // Number of views the shader should output positions for, set by the pipeline.
+    uint32_t get_view_count() const { return view_count; }
+    void set_view_count(uint32_t count) { view_count = count; }
     
 protected:
     // Sets the output vertex information. Should provide the stride in bytes of the output vertex attribs,
@@ -46,10 +128,60 @@ protected:
         this->in_vertex_stride_bytes = in_vertex_stride_bytes;
     }
 
+    // Optional outputs that route a primitive to a viewport, and/or a slice of an array render target. Each offset 
+    // points to a uint32_t inside of the output vertex. The value is read from the provoking (first) vertex of the primitive,
+    // so one draw can be spread across multiple viewports or texture array slices (cascades, cube faces, etc.)
+    void set_out_viewport_index_info(uint32_t out_viewport_index_offset_bytes)
+    {
+        this->out_viewport_index_offset_bytes = out_viewport_index_offset_bytes;
+    }
+
+    void set_out_render_target_array_index_info(uint32_t out_render_target_array_index_offset_bytes)
+    {
+        this->out_render_target_array_index_offset_bytes = out_render_target_array_index_offset_bytes;
+    }
+
+    // Multi-view output. The output vertex holds an array of get_view_count() float4_t clip positions, starting 
+    // at the given offset. Views are rasterized from their own position, but share every other attribute.
+    void set_out_view_info(uint32_t out_view_pos_offset_bytes)
+    {
+        this->out_view_pos_offset_bytes = out_view_pos_offset_bytes;
+    }
+
+    // Enable execute_batch(), instead of execute(). Input records, and output vertices, must be made of 32 bit values.
+    void set_batch_execution(bool enable)
+    {
+        this->batch_execution = enable;
+    }
+
+    // Transform a batch of row vectors [x, y, z, w] with the matrix, same as float4_t * float4x4_t. 
+    // Writes 4 outputs, starting at out.
+    static void transform_batch(const float4x4_t& m, const float8_t& x, const float8_t& y, const float8_t& z, const float8_t& w, float8_t* out)
+    {
+        for (uint32_t column = 0; column < 4; ++column)
+        {
+            out[column] = x * m[column] + y * m[4 + column] + z * m[8 + column] + w * m[12 + column];
+        }
+    }
+
+    // Clip position of the given view in the output vertex.
+    float4_t& out_view_position(uintptr_t out_vertex, uint32_t view_id)
+    {
+        return *(float4_t*)(out_vertex + out_view_pos_offset_bytes + view_id * sizeof(float4_t));
+    }
+
     uint32_t out_vertex_stride_bytes;
     uint32_t out_pos_offset_bytes;
     
     uint32_t in_vertex_stride_bytes;
+
+    // Offsets of the system value outputs, SWRAST_INVALID_OFFSET if not written by the shader.
+    uint32_t out_viewport_index_offset_bytes = SWRAST_INVALID_OFFSET;
+    uint32_t out_render_target_array_index_offset_bytes = SWRAST_INVALID_OFFSET;
+    uint32_t out_view_pos_offset_bytes = SWRAST_INVALID_OFFSET;
+
+    uint32_t view_count = 1;
+    bool batch_execution = false;
 };
 
 
@@ -81,10 +213,25 @@ public:
     // screen space coordinates, which might be used for other processes.
     // We will also want to pass any vertex attributes that might need to be 
     // used for texturing as well.
+    // Called from several threads at once, so it must not modify the shader.
     virtual float4_t execute(uintptr_t varying_address) = 0;
 
+    // Optional copy of the shader, constants included. Same as vertex_shader_t::clone().
+    virtual pixel_shader_t* clone() const { return nullptr; }
+    // Optional, same as vertex_shader_t::copy_to().
+    virtual bool copy_to(pixel_shader_t*) const { return false; }
+
+    // Varying information that is used to determine what and how-to interpolate data.
+    struct varying_info
+    {
+        uintptr_t       offset;
+        data_type       type;
+        interpolation   interp;
+    };
+
     uint32_t get_varying_stride_bytes() const { return in_varying_stride_bytes; }
     uint32_t get_position_offset_bytes() const { return in_pos_offset_bytes; }
+    const std::vector<varying_info>& get_varying_metadata() const { return varying_metadata; }
 
     // Defines the varying attributes for each pixel.
     void varying_attribute(uintptr_t offset, data_type type, interpolation interp);
@@ -124,15 +271,75 @@ protected:
     // The position should always be a float4_t type, that is in raster space (screen space.)
     uint32_t in_pos_offset_bytes;
 
-    // Varying information that is used to determine what and how-to interpolate data.
-    struct varying_info
+    std::vector<varying_info> varying_metadata;
+};
+
+
+// A thread of a compute shader group, and where it is in the dispatch.
+struct compute_thread_t
+{
+    uint3_t     group_id;
+    uint3_t     group_thread_id;
+    uint3_t     dispatch_thread_id;
+    // group_thread_id, flattened. x first, then y, then z.
+    uint32_t    group_index;
+    // Memory shared by every thread of the group, get_group_shared_size_bytes() large.
+    uintptr_t   group_shared;
+    // Memory of this thread only, get_thread_local_size_bytes() large. Keeps its contents across barriers.
+    uintptr_t   thread_local_memory;
+};
+
+
+// Compute shader implementation. Dispatches are split into groups of threads, and groups are spread across 
+// the workers of the context.
+// Barriers split the shader in phases. Every thread of a group runs a phase before any of them starts the next 
+// one, so group shared memory written in a phase can be read by the whole group in the following phases. 
+// Values a thread needs past a barrier go in its thread local memory. Neither is initialized.
+class SW_EXPORT_DLL compute_shader_t : public i_shader_t
+{
+public:
+    virtual ~compute_shader_t() { }
+
+    virtual void setup() = 0;
+
+    // Run a phase of a single thread, phase goes from 0 to get_barrier_count().
+    // Called from several threads at once, so it must not modify the shader.
+    virtual void execute(const compute_thread_t& thread, uint32_t phase) = 0;
+
+    uint3_t get_group_size() const { return group_size; }
+    uint32_t get_group_thread_count() const { return group_size.x * group_size.y * group_size.z; }
+    uint32_t get_group_shared_size_bytes() const { return group_shared_size_bytes; }
+    uint32_t get_thread_local_size_bytes() const { return thread_local_size_bytes; }
+    uint32_t get_barrier_count() const { return barrier_count; }
+
+protected:
+    // Threads per group, at most SWRAST_MAX_COMPUTE_GROUP_THREADS in total.
+    void set_group_size(uint32_t x, uint32_t y, uint32_t z)
     {
-        uintptr_t       offset;
-        data_type       type;
-        interpolation   interp;
-    };
+        this->group_size = uint3_t(x, y, z);
+    }
 
-    std::vector<varying_info> varying_metadata;
+    // Group shared memory, at most SWRAST_MAX_GROUP_SHARED_SIZE_BYTES.
+    void set_group_shared_size(uint32_t size_bytes)
+    {
+        this->group_shared_size_bytes = size_bytes;
+    }
+
+    void set_thread_local_size(uint32_t size_bytes)
+    {
+        this->thread_local_size_bytes = size_bytes;
+    }
+
+    // Number of barriers in the shader. execute() is called get_barrier_count() + 1 times per thread.
+    void set_barrier_count(uint32_t count)
+    {
+        this->barrier_count = count;
+    }
+
+    uint3_t group_size = uint3_t(1, 1, 1);
+    uint32_t group_shared_size_bytes = 0;
+    uint32_t thread_local_size_bytes = 0;
+    uint32_t barrier_count = 0;
 };
 
 } // swrast
\ No newline at end of file